@@ -1,150 +1,29 @@
 // CatLang.cpp
+#include <charconv>
 #include <iostream>
-#include <fstream>
 #include <string>
-#include <regex>
 #include <unordered_map>
-#include <sstream>
-#include <variant>
 #include <vector>
-#include <functional>
-#include <cctype>
-#include <algorithm>
+#include "output.hpp"
+#include "source.hpp"
+#include "intern.hpp"
+#include "lexer.hpp"
+#include "ast.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
 #include "function.hpp"
+#include "expressions.hpp"
 #include "statements.hpp"
+#include "fold.hpp"
+#include "jit.hpp"
+#include "bytecode.hpp"
+#include "vm.hpp"
+#include "cache.hpp"
+#include "snapshot.hpp"
+#include "transpile.hpp"
 
 using namespace std;
 
-void executeLine(const string &line,
-                 unordered_map<string, string> &strVars,
-                 unordered_map<string, double> &numVars,
-                 unordered_map<string, bool> &boolVars,
-                 unordered_map<string, CatFunction> &functions)
-{
-    // This simply reuses your existing main loop logic for line execution.
-    // For now, just re-run the logic that handles "purr", variables, and function calls.
-    smatch match;
-    regex purrRegex(R"(^\s*purr\s*~>\s*(.+);\s*$)");
-    regex strVarRegex(R"(^\s*str\s+([a-zA-Z_]\w*)\s*~>\s*(.+);\s*$)");
-    regex numVarRegex(R"(^\s*num\s+([a-zA-Z_]\w*)\s*~>\s*(.+);\s*$)");
-    regex boolVarRegex(R"(^\s*bool\s+([a-zA-Z_]\w*)\s*~>\s*(true|false)\s*;\s*$)", regex_constants::icase);
-    regex funcCallRegex(R"((\w+)\s*\((.*)\))");
-    regex ifRegex(R"(^\s*if\s*\((.*)\)\s*\{\s*$)");
-    regex elseRegex(R"(^\s*else\s*\{\s*$)");
-    if (regex_match(line, match, purrRegex))
-    {
-        string expr = match[1];
-        string replaced = replaceVars(expr, strVars, numVars, boolVars);
-
-        regex concatRegex(R"(\s*\+\s*)");
-        sregex_token_iterator iter(replaced.begin(), replaced.end(), concatRegex, -1);
-        sregex_token_iterator end;
-        string output;
-
-        for (; iter != end; ++iter)
-        {
-            string part = iter->str();
-            if (part == "endl")
-                cout << output << endl, output.clear();
-            else if (part.size() >= 2 && part.front() == '"' && part.back() == '"')
-                output += part.substr(1, part.size() - 2);
-            else
-                output += part;
-        }
-        if (!output.empty())
-            cout << output;
-        return;
-    }
-
-    if (regex_match(line, match, strVarRegex))
-    {
-        string name = match[1];
-        string val = match[2];
-        if (!val.empty() && val.front() == '"' && val.back() == '"')
-            val = val.substr(1, val.size() - 2);
-        strVars[name] = val;
-        return;
-    }
-
-    if (regex_match(line, match, numVarRegex))
-    {
-        string name = match[1];
-        string val = match[2];
-        try
-        {
-            numVars[name] = stod(val);
-        }
-        catch (...)
-        {
-            cerr << "Invalid numeric value: " << name << endl;
-        }
-        return;
-    }
-
-    if (regex_match(line, match, boolVarRegex))
-    {
-        string name = match[1];
-        string val = match[2];
-        boolVars[name] = (val == "true" || val == "TRUE");
-        return;
-    }
-
-    if (regex_match(line, match, funcCallRegex))
-    {
-        string funcName = match[1];
-        string args = match[2];
-
-        if (!functions.count(funcName))
-        {
-            cerr << "Undefined function: " << funcName << endl;
-            return;
-        }
-
-        const CatFunction &func = functions[funcName];
-        vector<CatValue> argValues;
-        stringstream ss(args);
-        string arg;
-
-        while (getline(ss, arg, ','))
-        {
-            arg.erase(0, arg.find_first_not_of(" \t"));
-            arg.erase(arg.find_last_not_of(" \t") + 1);
-            if (arg.empty())
-                continue;
-            if (arg.front() == '"' && arg.back() == '"')
-                argValues.push_back(arg.substr(1, arg.size() - 2));
-            else if (numVars.count(arg))
-                argValues.push_back(numVars[arg]);
-            else if (strVars.count(arg))
-                argValues.push_back(strVars[arg]);
-            else if (boolVars.count(arg))
-                argValues.push_back(boolVars[arg]);
-            else
-                try
-                {
-                    argValues.push_back(stod(arg));
-                }
-                catch (...)
-                {
-                    argValues.push_back(arg == "true");
-                }
-        }
-
-        executeFunction(func, argValues, strVars, numVars, boolVars);
-        return;
-    }
-
-    cerr << "Unknown command: " << line << endl;
-}
-
-// helper to trim
-static inline string trim(string s)
-{
-    s.erase(0, s.find_first_not_of(" \t\r\n"));
-    s.erase(s.find_last_not_of(" \t\r\n") + 1);
-    return s;
-}
-
 // file extension check
 bool hasValidCatExtension(const string &filename)
 {
@@ -156,835 +35,407 @@ bool hasValidCatExtension(const string &filename)
             filename.compare(filename.size() - ext2.size(), ext2.size(), ext2) == 0);
 }
 
-// format number (trim trailing zeros)
-string formatNumber(double num)
+// arena usage for --arena-stats
+void printArenaStats()
 {
-    ostringstream oss;
-    oss << num;
-    string s = oss.str();
-    if (s.find('.') != string::npos)
+    Arena::Stats ast = astArena.statistics();
+    Arena::Stats scratch = scratchArena.statistics();
+    cerr << "ast arena: " << ast.used << " bytes used, " << ast.reserved << " reserved in " << ast.chunks << " chunks" << endl;
+    cerr << "scratch arena: " << scratch.peak << " bytes peak, " << scratch.reserved << " reserved in " << scratch.chunks << " chunks" << endl;
+}
+
+// statistics printed when a run ends: arena usage and call-site caches on
+// request, memo counters whenever a memoized function was called, JIT counters
+// whenever --jit is on
+void printExitStats(bool arenaStats)
+{
+    if (arenaStats)
+        printArenaStats();
+    if (memoCache.hits + memoCache.misses > 0)
+        memoCache.printStats(cerr);
+    if (reportCallStats)
     {
-        while (!s.empty() && s.back() == '0')
-            s.pop_back();
-        if (!s.empty() && s.back() == '.')
-            s.pop_back();
+        size_t lookups = callCacheHits + callCacheMisses;
+        cerr << "call sites: " << callCacheHits << " cache hits, " << callCacheMisses << " misses";
+        if (lookups > 0)
+            cerr << " (" << (100.0 * callCacheHits / lookups) << "% hit rate)";
+        cerr << endl;
     }
-    return s;
+    if (jitThreshold > 0)
+        cerr << "jit: " << jitCompiled << " functions compiled, " << jitRejectedCount << " left interpreted" << endl;
 }
 
-// replace variables outside quotes (keeps literals intact)
-string replaceVars(const string &expr,
-                   const unordered_map<string, string> &strVars,
-                   const unordered_map<string, double> &numVars,
-                   const unordered_map<string, bool> &boolVars)
+// runs one top-level statement on the tree walker; false once a fatal runtime
+// error (a stack overflow) has stopped the script
+bool executeTopLevel(const Stmt &stmt)
 {
-    string result;
-    bool inQuotes = false;
-    string segment;
+    try
+    {
+        executeStatement(stmt, globalFrame, nullptr);
+    }
+    catch (const runtime_error &e)
+    {
+        errorStream() << e.what() << endl;
+        runAborted = true;
+        callDepth = 0;
+        pendingTailCall = TailCall();
+    }
+    scratchArena.reset();
+    return !runAborted;
+}
 
-    for (size_t i = 0; i < expr.size(); ++i)
+// run a script from stdin or a pipe as it arrives (tree engine): each top-level
+// statement is parsed, resolved and executed once it is complete, and its syntax
+// tree is dropped afterwards unless a function definition needs it
+bool runStream(const string &filename)
+{
+    int fd = openInput(filename);
+    if (fd < 0)
+        return false;
+    SourceStream stream(fd);
+    Resolver resolver;
+    resolver.streaming = true;
+    int errorLine = 0;
+
+    string_view text;
+    int line;
+    while (stream.next(text, line))
     {
-        char c = expr[i];
-        if (c == '"')
-        {
-            inQuotes = !inQuotes;
-            result += c;
-            continue;
-        }
-        if (inQuotes)
+        Arena::Mark mark = astArena.mark();
+        bool keep;
         {
-            result += c;
-            continue;
-        }
+            Parser parser(astArena.copy(text), line);
+            parser.synchronize(errorLine); // the rest of a broken line is skipped, as in a file
+            Program program = parser.parseProgram();
+            errorLine = parser.errorLine;
+            keep = resolver.resolveStatements(program);
 
-        segment += c;
-
-        // Process at end or at function call
-        if ((!inQuotes && (i + 1 == expr.size() || expr[i + 1] == '"' || expr[i + 1] == '(')) && !segment.empty())
-        {
-            // Skip segments that are function calls
-            if (segment.find('(') == string::npos)
+            globalFrame.resize(resolver.globals.slots.size());
+            for (const StmtPtr &stmt : program)
             {
-                // Replace only known variables
-                for (const auto &[var, val] : strVars)
-                    segment = regex_replace(segment, regex("\\b" + var + "\\b"), val);
-                for (const auto &[var, val] : numVars)
-                    segment = regex_replace(segment, regex("\\b" + var + "\\b"), formatNumber(val));
-                for (const auto &[var, val] : boolVars)
-                    segment = regex_replace(segment, regex("\\b" + var + "\\b"), val ? "true" : "false");
+                if (!executeTopLevel(*stmt))
+                    break;
             }
-            result += segment;
-            segment.clear();
         }
+        if (!keep)
+            astArena.rewind(mark);
+        if (runAborted)
+            break;
     }
+    resolver.reportUndeclared();
 
-    return result;
+    if (fd != STDIN_FILENO)
+        close(fd);
+    if (stream.failed)
+        cerr << "Could not read " << filename << endl;
+    return true;
 }
 
-// Evaluate numeric expression with parentheses and function calls.
-// This function will:
-//   - substitute known numeric variables
-//   - find function calls (non-nested in this pass) and execute them via executeFunction()
-//   - then parse expression with correct precedence (parentheses, *,/, +,-).
-// NOTE: it uses parseFunctionArgs and executeFunction from function.hpp
-double evalNumericExpression(string expr,
-                             const unordered_map<string, double> &numVars,
-                             const unordered_map<string, bool> &boolVars,
-                             unordered_map<string, string> &strVars_ref, // needed for parseFunctionArgs
-                             unordered_map<string, double> &numVars_ref,
-                             unordered_map<string, bool> &boolVars_ref,
-                             const unordered_map<string, CatFunction> &functions)
+// run a script on the VM starting from a snapshot (--snapshot-in) and/or save the
+// state it leaves behind (--snapshot-out)
+int runWithSnapshots(string_view text, const string &snapshotIn, const string &snapshotOut, bool dumpOnly)
 {
-    // 1) replace simple variables (numbers & bools) with numeric literal text
-    // but keep identifiers for function-call detection (we replace variables by number tokens)
-    // We'll replace identifiers that match numVars or boolVars to their numeric string
-    // but leave others (like function names) intact
-    auto replaceSimpleVars = [&](string &s)
+    Snapshot prelude;
+    if (!snapshotIn.empty() && !loadSnapshot(snapshotIn, prelude))
     {
-        string out;
-        for (size_t i = 0; i < s.size();)
-        {
-            if (isalpha((unsigned char)s[i]) || s[i] == '_')
-            {
-                size_t j = i;
-                while (j < s.size() && (isalnum((unsigned char)s[j]) || s[j] == '_'))
-                    ++j;
-                string ident = s.substr(i, j - i);
-                if (numVars.count(ident))
-                    out += formatNumber(numVars.at(ident));
-                else if (boolVars.count(ident))
-                    out += (boolVars.at(ident) ? "1" : "0");
-                else
-                    out += ident; // maybe a function name or undefined (will be caught)
-                i = j;
-            }
-            else
-            {
-                out.push_back(s[i++]);
-            }
-        }
-        s.swap(out);
-    };
-
-    replaceSimpleVars(expr);
+        cerr << "Could not load snapshot: " << snapshotIn << endl;
+        return 1;
+    }
 
-    // 2) Execute inner-most function calls iteratively:
-    // pattern: name(arg1, arg2, ...)
-    // We'll find calls with no nested parentheses inside the parentheses (i.e. handle simplest cases first).
-    // For nested calls, repeated application will handle them.
-    regex funcCallPattern(R"((\b[a-zA-Z_]\w*)\s*\((([^()]|(?R))*)\))"); // using PCRE-like recursion isn't supported; we'll instead use a simpler loop
-    // Simpler approach: find leftmost '(' and find its matching ')' and check token before '(' for name.
-    auto findNextFuncCall = [&](const string &s, size_t &startPos, size_t &endPos, string &fname, string &argsout) -> bool
+    Program program = parseProgram(text);
+    Resolver resolver;
+    resolver.predeclare(prelude.globals, prelude.textFunctions());
+    resolver.resolveProgram(program);
+    optimizeProgram(program, !snapshotOut.empty());
+    const FrameLayout &globals = resolver.globals;
+    BytecodeProgram compiled = compileToBytecode(program, globals, std::move(prelude.program));
+    if (dumpOnly)
     {
-        // find '('
-        size_t p = s.find('(', startPos);
-        if (p == string::npos)
-            return false;
-        // find matching ')' by counting
-        size_t j = p;
-        int depth = 0;
-        for (; j < s.size(); ++j)
-        {
-            if (s[j] == '(')
-                ++depth;
-            else if (s[j] == ')')
-            {
-                --depth;
-                if (depth == 0)
-                    break;
-            }
-        }
-        if (j >= s.size())
-            return false;
-        // find function name before '(' (skip whitespace)
-        size_t k = p;
-        while (k > 0 && isspace((unsigned char)s[k - 1]))
-            --k;
-        size_t nameEnd = k;
-        size_t nameStart = nameEnd;
-        while (nameStart > 0 && (isalnum((unsigned char)s[nameStart - 1]) || s[nameStart - 1] == '_'))
-            --nameStart;
-        if (nameStart == nameEnd)
-            return false;
-        fname = s.substr(nameStart, nameEnd - nameStart);
-        argsout = s.substr(p + 1, j - (p + 1));
-        startPos = nameStart;
-        endPos = j;
-        return true;
-    };
+        dumpBytecode(compiled, cout);
+        return 0;
+    }
 
-    // iterate until no function calls remain
-    while (true)
+    VM vm(compiled);
+    prelude.restore(vm);
+    vm.run();
+    output.flush();
+    if (runAborted)
+        return 1;
+    if (!snapshotOut.empty() && !saveSnapshot(snapshotOut, compiled, globals, vm))
     {
-        size_t sp = 0;
-        size_t ep = 0;
-        string fname, argsstr;
-        if (!findNextFuncCall(expr, sp, ep, fname, argsstr))
-            break;
+        cerr << "Could not write snapshot: " << snapshotOut << endl;
+        return 1;
+    }
+    return 0;
+}
 
-        // ensure function exists
-        if (!functions.count(fname))
+int main(int argc, char *argv[])
+{
+    initNativeStack();
+
+    string filename;
+    string engine = "tree";
+    bool depthGiven = false; // --max-depth, else the engine's default
+    bool flushGiven = false; // --flush, built into --emit-cpp output
+    bool dumpOnly = false;
+    bool arenaStats = false;
+    bool useCache = false;
+    string cacheDir;
+    string snapshotIn, snapshotOut;
+    bool emitting = false;
+    bool build = false;
+    string cppPath;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg.rfind("--engine=", 0) == 0)
+            engine = arg.substr(9);
+        else if (arg.rfind("--flush=", 0) == 0)
         {
-            cerr << "Undefined function: " << fname << endl;
-            // remove the call to avoid infinite loop: replace with 0
-            expr.replace(sp, ep - sp + 1, "0");
-            continue;
+            if (!parseFlushPolicy(arg.substr(8), output.policy))
+            {
+                cerr << "Unknown flush policy: " << arg.substr(8) << " (expected line, full or none)" << endl;
+                return 1;
+            }
+            flushGiven = true;
         }
-
-        // parse args using helper in function.hpp
-        vector<CatValue> parsedArgs = parseFunctionArgs(argsstr, strVars_ref, numVars_ref, boolVars_ref);
-
-        // execute
-        CatValue cres = executeFunction(functions.at(fname), parsedArgs, strVars_ref, numVars_ref, boolVars_ref);
-
-        // convert result to numeric string (for insertion)
-        string numericReplacement = "0";
-        if (holds_alternative<double>(cres))
-            numericReplacement = formatNumber(get<double>(cres));
-        else if (holds_alternative<bool>(cres))
-            numericReplacement = get<bool>(cres) ? "1" : "0";
-        else if (holds_alternative<string>(cres))
+        else if (arg.rfind("--max-depth=", 0) == 0)
         {
-            // string in numeric context -> try parse number, else 0
-            try
+            const char *first = arg.data() + 12, *last = arg.data() + arg.size();
+            auto [end, error] = from_chars(first, last, maxCallDepth);
+            if (error != errc() || end != last || first == last || maxCallDepth == 0)
             {
-                double v = stod(get<string>(cres));
-                numericReplacement = formatNumber(v);
+                cerr << "Invalid --max-depth: " << arg.substr(12) << " (expected a positive number of calls)" << endl;
+                return 1;
             }
-            catch (...)
+            depthGiven = true;
+        }
+        else if (arg.rfind("--jit=", 0) == 0)
+        {
+            string mode = arg.substr(6);
+            if (mode == "off" || mode == "on")
+                jitThreshold = mode == "on" ? 1 : 0;
+            else
             {
-                numericReplacement = "0";
+                bool valid = mode.rfind("threshold=", 0) == 0;
+                if (valid)
+                {
+                    const char *first = mode.data() + 10, *last = mode.data() + mode.size();
+                    auto [end, error] = from_chars(first, last, jitThreshold);
+                    valid = error == errc() && end == last && first != last && jitThreshold > 0;
+                }
+                if (!valid)
+                {
+                    cerr << "Invalid --jit: " << mode << " (expected off, on or threshold=n)" << endl;
+                    return 1;
+                }
             }
         }
+        else if (arg == "--call-stats")
+            reportCallStats = true;
+        else if (arg == "--memoize")
+            memoizeAll = true;
+        else if (arg.rfind("--memo-size=", 0) == 0)
+        {
+            const char *first = arg.data() + 12, *last = arg.data() + arg.size();
+            auto [end, error] = from_chars(first, last, memoCache.capacity);
+            if (error != errc() || end != last || first == last)
+            {
+                cerr << "Invalid --memo-size: " << arg.substr(12) << " (expected a number of entries)" << endl;
+                return 1;
+            }
+        }
+        else if (arg == "-O0" || arg == "-O1")
+            optimizationLevel = arg[2] - '0';
+        else if (arg == "--dump-folds")
+            dumpFolds = true;
+        else if (arg == "--dump-bytecode")
+            dumpOnly = true;
+        else if (arg == "--arena-stats")
+            arenaStats = true;
+        else if (arg == "--cache")
+            useCache = true;
+        else if (arg.rfind("--cache-dir=", 0) == 0)
+        {
+            useCache = true;
+            cacheDir = arg.substr(12);
+        }
+        else if (arg.rfind("--snapshot-in=", 0) == 0)
+            snapshotIn = arg.substr(14);
+        else if (arg.rfind("--snapshot-out=", 0) == 0)
+            snapshotOut = arg.substr(15);
+        else if (arg == "--emit-cpp")
+            emitting = true;
+        else if (arg.rfind("--emit-cpp=", 0) == 0)
+        {
+            emitting = true;
+            cppPath = arg.substr(11);
+        }
+        else if (arg == "--build")
+            build = true;
+        else if (filename.empty())
+            filename = arg;
         else
         {
-            numericReplacement = "0";
+            cerr << "Unexpected argument: " << arg << endl;
+            return 1;
         }
-
-        // replace fname(...) range with numericReplacement
-        // note: ep is ')' index; we replace from sp .. ep inclusive
-        expr.replace(sp, ep - sp + 1, numericReplacement);
     }
 
-    // 3) Now we have an expression with only numbers, operators, parentheses (hopefully). Evaluate it with precedence.
-
-    // Shunting-yard or recursive descent parser. Implement recursive descent:
-    const string s = expr;
-    size_t pos = 0;
-    function<void()> skipSpaces = [&]()
-    { while (pos < s.size() && isspace((unsigned char)s[pos])) ++pos; };
-
-    function<double()> parseExpr; // forward
-    function<double()> parseTerm;
-    function<double()> parseFactor;
-
-    parseFactor = [&]() -> double
+    if (filename.empty())
     {
-        skipSpaces();
-        if (pos < s.size() && s[pos] == '(')
-        {
-            ++pos;
-            double v = parseExpr();
-            skipSpaces();
-            if (pos < s.size() && s[pos] == ')')
-                ++pos;
-            return v;
-        }
-        // parse number (with optional leading + or -)
-        size_t start = pos;
-        if (pos < s.size() && (s[pos] == '+' || s[pos] == '-'))
-            ++pos;
-        bool dotSeen = false;
-        while (pos < s.size() && (isdigit((unsigned char)s[pos]) || s[pos] == '.'))
-        {
-            if (s[pos] == '.')
-            {
-                if (dotSeen)
-                    break;
-                dotSeen = true;
-            }
-            ++pos;
-        }
-        string numtok = s.substr(start, pos - start);
-        if (numtok.empty() || numtok == "+" || numtok == "-")
-        {
-            // invalid - return 0
-            return 0.0;
-        }
-        try
-        {
-            return stod(numtok);
-        }
-        catch (...)
-        {
-            return 0.0;
-        }
-    };
-
-    parseTerm = [&]() -> double
+        cerr << "Usage: catlang [--engine=tree|vm] [--flush=line|full|none] [--max-depth=n] [--jit=off|on|threshold=n]"
+             << " [--memoize] [--memo-size=n]"
+             << " [-O0|-O1] [--dump-folds] [--dump-bytecode] [--arena-stats] [--call-stats] [--cache] [--cache-dir=dir]"
+             << " [--snapshot-in=file] [--snapshot-out=file] [--emit-cpp[=file.cpp] [--build]] <file>.cat|-" << endl;
+        return 1;
+    }
+    if (engine != "tree" && engine != "vm")
     {
-        double val = parseFactor();
-        while (true)
-        {
-            skipSpaces();
-            if (pos >= s.size())
-                break;
-            char op = s[pos];
-            if (op != '*' && op != '/')
-                break;
-            ++pos;
-            double rhs = parseFactor();
-            if (op == '*')
-                val *= rhs;
-            else if (op == '/')
-                val /= rhs;
-        }
-        return val;
-    };
-
-    parseExpr = [&]() -> double
+        cerr << "Unknown engine: " << engine << " (expected tree or vm)" << endl;
+        return 1;
+    }
+    if (!depthGiven && engine == "vm")
+        maxCallDepth = vmMaxDepth;
+    if (jitThreshold > 0 && engine != "tree")
     {
-        double val = parseTerm();
-        while (true)
-        {
-            skipSpaces();
-            if (pos >= s.size())
-                break;
-            char op = s[pos];
-            if (op != '+' && op != '-')
-                break;
-            ++pos;
-            double rhs = parseTerm();
-            if (op == '+')
-                val += rhs;
-            else
-                val -= rhs;
-        }
-        return val;
-    };
-
-    try
+        cerr << "--jit compiles syntax trees and needs --engine=tree" << endl;
+        return 1;
+    }
+    if (useCache && engine != "vm" && !dumpOnly)
     {
-        pos = 0;
-        double res = parseExpr();
-        return res;
+        cerr << "--cache holds compiled bytecode and needs --engine=vm" << endl;
+        return 1;
     }
-    catch (...)
+    bool snapshots = !snapshotIn.empty() || !snapshotOut.empty();
+    if (snapshots && (engine != "vm" || useCache))
     {
-        cerr << "Invalid numeric expression: " << expr << endl;
-        return 0.0;
+        cerr << "Snapshots hold VM state: use them with --engine=vm and without --cache" << endl;
+        return 1;
     }
-}
-
-int main(int argc, char *argv[])
-{
-    if (argc < 2)
+    if (emitting && (snapshots || useCache))
     {
-        cerr << "Usage: catlang <file>.cat" << endl;
+        cerr << "--emit-cpp translates the script on its own: use it without snapshots or --cache" << endl;
         return 1;
     }
-    string filename = argv[1];
-    if (!hasValidCatExtension(filename))
+    if (build && (!emitting || cppPath == "-"))
     {
-        cerr << "Only .cat or .catlang files allowed" << endl;
+        cerr << "--build compiles the output of --emit-cpp and needs it written to a file" << endl;
         return 1;
     }
-
-    ifstream file(filename);
-    if (!file.is_open())
+    // stdin ("-") and pipes may carry any script; files need a CatLang extension
+    bool streamed = isStreamInput(filename);
+    if (!streamed && !hasValidCatExtension(filename))
     {
-        cerr << "Could not open file: " << filename << endl;
+        cerr << "Only .cat or .catlang files allowed" << endl;
         return 1;
     }
 
-    unordered_map<string, string> strVars;
-    unordered_map<string, double> numVars;
-    unordered_map<string, bool> boolVars;
-    unordered_map<string, CatFunction> functions;
-
-    string line;
-    string outputLineBuffer; // buffer for purr concatenation across purr statements
-
-    // regexes
-    regex purrRegex(R"(^\s*purr\s*~>\s*(.*?)\s*;\s*$)");
-    regex strVarRegex(R"(^\s*str\s+([a-zA-Z_]\w*)\s*~>\s*(.+);\s*$)");
-    regex numVarRegex(R"(^\s*num\s+([a-zA-Z_]\w*)\s*~>\s*(.+);\s*$)");
-    regex boolVarRegex(R"(^\s*bool\s+([a-zA-Z_]\w*)\s*~>\s*(true|false)\s*;\s*$)", regex_constants::icase);
-    regex funcDefRegex(R"(^\s*(num|str|bool|void)\s+([a-zA-Z_]\w*)\s*\((.*)\)\s*\{\s*$)");
-    regex funcCallRegex(R"((\w+)\(([^)]*)\))");
-    regex assignFuncCallRegex(R"(^\s*(num|str|bool)\s+([a-zA-Z_]\w*)\s*~>\s*([a-zA-Z_]\w*\(.*\))\s*;\s*$)");
-    regex funcCallOnlyRegex(R"(^\s*([a-zA-Z_]\w*)\s*\((.*)\)\s*;\s*$)");
-    regex funcRegex(R"(^\s*(num|str|bool|void)\s+([a-zA-Z_]\w*)\s*\(([^)]*)\)\s*\{\s*$)");
-    regex ifRegex(R"(^\s*if\s*\((.+)\)\s*\{\s*$)");
-    regex elseRegex(R"(^\s*(?:\}\s*)?else\s*\{\s*$)");
-    bool inMultilineComment = false;
-    string lineBuffer;
-    while (getline(file, line))
+    if (streamed && engine == "tree" && !dumpOnly && !emitting)
     {
-        // handle multi-line comment continuations
-        if (inMultilineComment)
+        if (!runStream(filename))
         {
-            size_t endc = line.find("*/");
-            if (endc != string::npos)
-            {
-                line = line.substr(endc + 2);
-                inMultilineComment = false;
-            }
-            else
-                continue;
+            cerr << "Could not open file: " << filename << endl;
+            return 1;
         }
+        output.flush();
+        printExitStats(arenaStats);
+        return runAborted ? 1 : 0;
+    }
 
-        // strip start of multiline comment on this line
-        size_t startc = line.find("/*");
-        if (startc != string::npos)
-        {
-            size_t endc = line.find("*/", startc + 2);
-            if (endc != string::npos)
-            {
-                // comment open and close same line: remove the segment
-                line.erase(startc, endc - startc + 2);
-            }
-            else
-            {
-                line = line.substr(0, startc);
-                inMultilineComment = true;
-            }
-        }
-
-        // single-line comments
-        size_t singlec = line.find("//");
-        if (singlec != string::npos)
-            line = line.substr(0, singlec);
-
-        // skip empty
-        if (line.find_first_not_of(" \t\r\n") == string::npos)
-            continue;
-
-        smatch match;
-
-        // 1) function definition (must be handled before other patterns)
-        if (regex_match(line, match, funcDefRegex))
-        {
-            string returnType = match[1];
-            string fname = match[2];
-            string argsList = match[3];
-
-            // parse args
-            vector<FuncArg> args;
-            stringstream ss(argsList);
-            string a;
-            while (getline(ss, a, ','))
-            {
-                a = trim(a);
-                if (a.empty())
-                    continue;
-                stringstream as(a);
-                string t, n;
-                as >> t >> n;
-                if (!t.empty() && !n.empty())
-                    args.push_back({t, n});
-            }
-
-            // collect body with brace counting
-            vector<string> body;
-            int braceCount = 1; // already saw opening '{' in the header line
-            while (getline(file, line))
-            {
-                // adjust counts for nested braces
-                for (char ch : line)
-                {
-                    if (ch == '{')
-                        ++braceCount;
-                    else if (ch == '}')
-                        --braceCount;
-                }
-                body.push_back(line);
-                if (braceCount == 0)
-                    break;
-            }
-
-            // store (note: body includes the closing '}' line; executeFunction should handle lines/returns)
-            functions[fname] = CatFunction{returnType, args, body};
-            continue;
-        }
-
-        // 2) assignment from function call like: num x ~> add(a,b);
-        if (regex_match(line, match, assignFuncCallRegex))
-        {
-            string varType = match[1];
-            string varName = match[2];
-            string funcCall = match[3];
-
-            // extract function name and arg list
-            smatch callm;
-            regex callRegex(R"(^\s*([a-zA-Z_]\w*)\s*\((.*)\)\s*$)");
-            if (!regex_match(funcCall, callm, callRegex))
-            {
-                cerr << "Invalid function call in assignment: " << funcCall << endl;
-                continue;
-            }
-            string fname = callm[1];
-            string argList = callm[2];
-
-            if (!functions.count(fname))
-            {
-                cerr << "Undefined function: " << fname << endl;
-                continue;
-            }
-
-            vector<CatValue> parsedArgs = parseFunctionArgs(argList, strVars, numVars, boolVars);
-            CatValue cres = executeFunction(functions.at(fname), parsedArgs, strVars, numVars, boolVars);
-
-            // assign according to varType
-            if (varType == "num")
-            {
-                if (holds_alternative<double>(cres))
-                    numVars[varName] = get<double>(cres);
-                else if (holds_alternative<bool>(cres))
-                    numVars[varName] = get<bool>(cres) ? 1.0 : 0.0;
-                else
-                {
-                    cerr << "Type mismatch: expected num from function " << fname << endl;
-                }
-            }
-            else if (varType == "str")
-            {
-                if (holds_alternative<string>(cres))
-                    strVars[varName] = get<string>(cres);
-                else
-                {
-                    cerr << "Type mismatch: expected str from function " << fname << endl;
-                }
-            }
-            else if (varType == "bool")
-            {
-                if (holds_alternative<bool>(cres))
-                    boolVars[varName] = get<bool>(cres);
-                else
-                {
-                    cerr << "Type mismatch: expected bool from function " << fname << endl;
-                }
-            }
-            continue;
-        }
-
-        // --- purr command ---
-        if (regex_match(line, match, purrRegex))
-        {
-            string expr = match[1];
-
-            // Check if it's a function call like hello(thing)
-            regex funcCallOnlyRegex(R"((\w+)\((.*)\))");
-            smatch funcMatch;
-            string output;
-
-            if (regex_match(expr, funcMatch, funcCallOnlyRegex))
-            {
-                string funcName = funcMatch[1];
-                string argList = funcMatch[2];
-
-                if (!functions.count(funcName))
-                {
-                    cerr << "Undefined function: " << funcName << endl;
-                }
-                else
-                {
-                    vector<CatValue> argValues = parseFunctionArgs(argList, strVars, numVars, boolVars);
-                    CatValue result = executeFunction(functions[funcName], argValues, strVars, numVars, boolVars);
-
-                    // Convert result to string for printing
-                    if (holds_alternative<string>(result))
-                        output = get<string>(result);
-                    else if (holds_alternative<double>(result))
-                        output = formatNumber(get<double>(result));
-                    else if (holds_alternative<bool>(result))
-                        output = get<bool>(result) ? "true" : "false";
-                }
-            }
-            else
-            {
-                // Handle concatenation with '+'
-                regex concatRegex(R"(\s*\+\s*)");
-                sregex_token_iterator iter(expr.begin(), expr.end(), concatRegex, -1);
-                sregex_token_iterator end;
-
-                for (; iter != end; ++iter)
-                {
-                    string part = iter->str();
-                    part.erase(0, part.find_first_not_of(" \t"));
-                    part.erase(part.find_last_not_of(" \t") + 1);
-
-                    if (part == "endl")
-                    {
-                        output += "\n";
-                    }
-                    else if (!part.empty() && part.front() == '"' && part.back() == '"')
-                    {
-                        output += part.substr(1, part.size() - 2); // strip quotes
-                    }
-                    else if (strVars.count(part))
-                    {
-                        output += strVars[part];
-                    }
-                    else if (numVars.count(part))
-                    {
-                        output += formatNumber(numVars[part]);
-                    }
-                    else if (boolVars.count(part))
-                    {
-                        output += boolVars[part] ? "true" : "false";
-                    }
-                    else
-                    {
-                        output += part; // fallback
-                    }
-                }
-            }
+    // map the whole script and parse it once; tokens and literals view the mapping
+    // (the bytecode compiler needs whole programs, so a stream is read to its end)
+    SourceFile source;
+    if (!source.open(filename))
+    {
+        cerr << "Could not open file: " << filename << endl;
+        return 1;
+    }
 
-            cout << output;
-            continue;
-        }
+    if (snapshots)
+    {
+        int status = runWithSnapshots(source.text(), snapshotIn, snapshotOut, dumpOnly);
+        printExitStats(arenaStats);
+        return status;
+    }
 
-        // 4) variable declarations that may include expressions or function calls
-        if (regex_match(line, match, numVarRegex))
-        {
-            string varName = match[1];
-            string expr = match[2];
-            try
-            {
-                double value = evaluateNumericExpression(expr, numVars); // new function
-                numVars[varName] = value;
-            }
-            catch (...)
-            {
-                cerr << "Invalid numeric value: " << varName << endl;
-            }
-            continue;
-        }
+    // an unchanged script reuses its compiled bytecode (a stream only with --cache-dir)
+    if (useCache && !(streamed && cacheDir.empty()))
+    {
+        uint64_t hash = hashSource(source.text());
+        string cachePath = cachePathFor(filename, cacheDir, hash);
+        BytecodeProgram compiled;
+        if (!loadBytecodeCache(cachePath, hash, source.size, (uint8_t)optimizationLevel, compiled))
+        {
+            Program program = parseProgram(source.text());
+            FrameLayout globals = resolveProgram(program);
+            optimizeProgram(program);
+            compiled = compileToBytecode(program, globals);
+            if (errorsReported == 0) // a cached run would not repeat the diagnostics
+                saveBytecodeCache(cachePath, hash, source.size, (uint8_t)optimizationLevel, compiled);
+        }
+        if (dumpOnly)
+        {
+            dumpBytecode(compiled, cout);
+            return 0;
+        }
+        runOnVM(compiled);
+        output.flush();
+        printExitStats(arenaStats);
+        return runAborted ? 1 : 0;
+    }
 
-        if (regex_match(line, match, strVarRegex))
-        {
-            string varName = match[1];
-            string rhs = trim(match[2]);
-            // if rhs is a function call, handle it
-            smatch fm;
-            regex callRx(R"(^\s*([a-zA-Z_]\w*)\s*\((.*)\)\s*$)");
-            if (regex_match(rhs, fm, callRx))
-            {
-                string fname = fm[1];
-                string argList = fm[2];
-                if (!functions.count(fname))
-                {
-                    cerr << "Undefined function: " << fname << endl;
-                    continue;
-                }
-                vector<CatValue> parsedArgs = parseFunctionArgs(argList, strVars, numVars, boolVars);
-                CatValue cres = executeFunction(functions.at(fname), parsedArgs, strVars, numVars, boolVars);
-                if (holds_alternative<string>(cres))
-                    strVars[varName] = get<string>(cres);
-                else
-                    cerr << "Type mismatch: expected str from function " << fname << endl;
-            }
-            else
-            {
-                // literal string expected
-                if (!rhs.empty() && rhs.front() == '"' && rhs.back() == '"')
-                    strVars[varName] = rhs.substr(1, rhs.size() - 2);
-                else
-                {
-                    // maybe variable name
-                    if (strVars.count(rhs))
-                        strVars[varName] = strVars[rhs];
-                    else
-                    {
-                        cerr << "Invalid string assignment: " << rhs << endl;
-                    }
-                }
-            }
-            continue;
-        }
+    Program program = parseProgram(source.text());
+    FrameLayout globals = resolveProgram(program);
+    optimizeProgram(program);
 
-        if (regex_match(line, match, boolVarRegex))
-        {
-            string varName = match[1];
-            string rhs = trim(match[2]);
-            // rhs could be function call
-            smatch fm;
-            regex callRx(R"(^\s*([a-zA-Z_]\w*)\s*\((.*)\)\s*$)");
-            if (regex_match(rhs, fm, callRx))
-            {
-                string fname = fm[1];
-                string argList = fm[2];
-                if (!functions.count(fname))
-                {
-                    cerr << "Undefined function: " << fname << endl;
-                    continue;
-                }
-                vector<CatValue> parsedArgs = parseFunctionArgs(argList, strVars, numVars, boolVars);
-                CatValue cres = executeFunction(functions.at(fname), parsedArgs, strVars, numVars, boolVars);
-                if (holds_alternative<bool>(cres))
-                    boolVars[varName] = get<bool>(cres);
-                else
-                    cerr << "Type mismatch: expected bool from function " << fname << endl;
-            }
-            else
-            {
-                boolVars[varName] = (rhs == "true" || rhs == "TRUE");
-            }
-            continue;
-        }
+    if (dumpOnly)
+    {
+        dumpBytecode(compileToBytecode(program, globals), cout);
+        return 0;
+    }
 
-        // 5) standalone function call with semicolon, e.g., sayGoodbye(username);
-        if (regex_match(line, match, funcCallOnlyRegex))
+    if (emitting)
+    {
+        // hello.cat -> hello.cpp; a streamed script goes to stdout unless a file was named
+        if (cppPath.empty())
+            cppPath = streamed ? "-" : cppPathFor(filename);
+        if (build && cppPath == "-")
         {
-            string fname = match[1];
-            string argList = match[2];
-            if (!functions.count(fname))
-            {
-                cerr << "Undefined function: " << fname << endl;
-                continue;
-            }
-            vector<CatValue> parsedArgs = parseFunctionArgs(argList, strVars, numVars, boolVars);
-            executeFunction(functions.at(fname), parsedArgs, strVars, numVars, boolVars);
-            continue;
+            cerr << "--build needs --emit-cpp=file.cpp for a script read from a stream" << endl;
+            return 1;
         }
-        // --- Function definitions ---
-        if (regex_match(line, match, funcRegex))
+        if (!emitCpp(program, globals, streamed ? "<stdin>" : filename, cppPath, flushGiven))
         {
-            string returnType = match[1];
-            string funcName = match[2];
-            string argsList = match[3];
-
-            vector<FuncArg> args;
-            stringstream ss(argsList);
-            string arg;
-            while (getline(ss, arg, ','))
-            {
-                stringstream argStream(arg);
-                string type, name;
-                argStream >> type >> name;
-                if (!type.empty() && !name.empty())
-                {
-                    args.push_back({type, name});
-                }
-            }
-
-            vector<string> funcBody;
-            int braceCount = 1; // already found one '{'
-
-            // Read the function body until closing '}'
-            while (getline(file, line))
-            {
-                size_t openBraces = count(line.begin(), line.end(), '{');
-                size_t closeBraces = count(line.begin(), line.end(), '}');
-                braceCount += openBraces;
-                braceCount -= closeBraces;
-
-                funcBody.push_back(line);
-                if (braceCount == 0)
-                    break;
-            }
-
-            // Register the function
-            CatFunction func;
-            func.returnType = returnType;
-            func.args = args;
-            func.body = funcBody;
-            functions[funcName] = func;
-
-            continue; // go to next line after the function
+            cerr << "Could not write " << cppPath << endl;
+            return 1;
         }
-        // --- If statements ---
-
-        if (regex_match(line, match, ifRegex))
+        string exePath;
+        if (build && !buildCpp(cppPath, exePath))
         {
-            string conditionExpr = match[1];
-
-            // Gather true block
-            vector<string> trueBlock;
-            int braceDepth = 1;
-            while (getline(file, line))
-            {
-                if (line.find('{') != string::npos)
-                    braceDepth++;
-                if (line.find('}') != string::npos)
-                    braceDepth--;
-                if (braceDepth == 0)
-                    break;
-                trueBlock.push_back(line);
-            }
-
-            // Check if next line is else
-            streampos prevPos = file.tellg();
-            string nextLine;
-            vector<string> falseBlock;
-            if (getline(file, nextLine) && regex_match(nextLine, elseRegex))
-            {
-                braceDepth = 1;
-                while (getline(file, line))
-                {
-                    if (line.find('{') != string::npos)
-                        braceDepth++;
-                    if (line.find('}') != string::npos)
-                        braceDepth--;
-                    if (braceDepth == 0)
-                        break;
-                    falseBlock.push_back(line);
-                }
-            }
-            else
-            {
-                file.seekg(prevPos);
-            }
-
-            bool condResult = evaluateCondition(conditionExpr, strVars, numVars, boolVars);
-            executeIfStatement(condResult, trueBlock, falseBlock, strVars, numVars, boolVars, functions);
-            continue;
+            cerr << "Could not compile " << cppPath << " into " << exePath << endl;
+            return 1;
         }
-        if (regex_match(line, match, ifRegex))
-        {
-            std::string condExpr = match[1];
-            bool condResult = evaluateCondition(condExpr, strVars, numVars, boolVars);
-
-            std::vector<std::string> trueBlock;
-            std::vector<std::string> falseBlock;
-
-            int braceCount = 1; // already consumed opening {
-
-            bool readingTrue = true;
-            while (getline(file, line))
-            {
-                braceCount += std::count(line.begin(), line.end(), '{');
-                braceCount -= std::count(line.begin(), line.end(), '}');
-
-                if (regex_match(line, elseRegex) && braceCount == 1)
-                {
-                    readingTrue = false;
-                    continue; // skip the `else {` line
-                }
-
-                if (readingTrue)
-                    trueBlock.push_back(line);
-                else
-                    falseBlock.push_back(line);
-
-                if (braceCount == 0)
-                    break; // finished both blocks
-            }
+        return 0;
+    }
 
-            executeIfStatement(condResult, trueBlock, falseBlock, strVars, numVars, boolVars, functions);
-            continue; // do not fall through to unknown command
-        }
-        // 6) unknown command
-        cerr << "Unknown command: " << line << endl;
+    if (engine == "vm")
+    {
+        runOnVM(program, globals);
+        output.flush();
+        printExitStats(arenaStats);
+        return runAborted ? 1 : 0;
     }
 
-    // flush any pending purr buffer
-    if (!outputLineBuffer.empty())
+    // run top-level statements in order; function definitions register themselves
+    globalFrame.resize(globals.slots.size());
+    for (const StmtPtr &stmt : program)
     {
-        cout << outputLineBuffer << endl;
-        outputLineBuffer.clear();
+        if (!executeTopLevel(*stmt))
+            break;
     }
 
-    return 0;
+    output.flush();
+    printExitStats(arenaStats);
+    return runAborted ? 1 : 0;
 }
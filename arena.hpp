@@ -0,0 +1,182 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// --- Bump allocator ---
+// Hands out memory by bumping a pointer through large chunks. Nothing is freed
+// piecemeal: rewind() drops everything allocated since a mark and reset() empties
+// the arena while keeping its chunks for reuse, both in O(1) per chunk rather than
+// per object. Objects placed here must not need their destructors run (or be
+// destroyed before the arena is rewound past them).
+// It is a std::pmr::memory_resource, so pmr containers can live in it too.
+class Arena : public std::pmr::memory_resource
+{
+public:
+    static const size_t maxChunkGrowth = 4 * 1024 * 1024;
+
+    struct Mark
+    {
+        size_t chunk;
+        size_t offset;
+    };
+
+    struct Stats
+    {
+        size_t reserved = 0; // bytes obtained from malloc
+        size_t used = 0;     // bytes handed out and not rewound
+        size_t peak = 0;     // highest value of used
+        size_t chunks = 0;
+    };
+
+    explicit Arena(size_t firstChunk = 64 * 1024) : chunkSize(firstChunk) {}
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena()
+    {
+        release();
+    }
+
+    void *allocate(size_t bytes, size_t align = alignof(std::max_align_t))
+    {
+        if (!chunks.empty())
+        {
+            size_t start = (offset + align - 1) & ~(align - 1);
+            if (start + bytes <= chunks[current].size)
+            {
+                stats.used += start + bytes - offset;
+                offset = start + bytes;
+                stats.peak = stats.used > stats.peak ? stats.used : stats.peak;
+                return chunks[current].data + start;
+            }
+        }
+        return allocateSlow(bytes, align);
+    }
+
+    template <typename T, typename... Args>
+    T *create(Args &&...args)
+    {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // copy of a string whose characters live in the arena
+    std::string_view copy(std::string_view text)
+    {
+        if (text.empty())
+            return std::string_view();
+        char *data = (char *)allocate(text.size(), 1);
+        std::memcpy(data, text.data(), text.size());
+        return std::string_view(data, text.size());
+    }
+
+    Mark mark() const
+    {
+        return {current, offset};
+    }
+
+    void rewind(Mark to)
+    {
+        for (size_t i = to.chunk; i <= current && i < chunks.size(); ++i)
+            stats.used -= (i == current ? offset : chunks[i].filled) - (i == to.chunk ? to.offset : 0);
+        current = to.chunk;
+        offset = to.offset;
+    }
+
+    void reset()
+    {
+        rewind({0, 0});
+    }
+
+    // returns every chunk to the system
+    void release()
+    {
+        for (Chunk &chunk : chunks)
+            std::free(chunk.data);
+        chunks.clear();
+        current = 0;
+        offset = 0;
+        stats = Stats();
+    }
+
+    Stats statistics() const
+    {
+        Stats out = stats;
+        out.chunks = chunks.size();
+        return out;
+    }
+
+private:
+    struct Chunk
+    {
+        char *data;
+        size_t size;
+        size_t filled; // offset reached before moving on to the next chunk
+    };
+
+    void *allocateSlow(size_t bytes, size_t align)
+    {
+        if (!chunks.empty())
+            chunks[current].filled = offset;
+
+        // move on to the next chunk, reusing it when it is large enough
+        size_t next = chunks.empty() ? 0 : current + 1;
+        size_t need = bytes + align;
+        if (next < chunks.size() && chunks[next].size < need)
+        {
+            stats.reserved -= chunks[next].size;
+            std::free(chunks[next].data);
+            chunks.erase(chunks.begin() + next);
+        }
+        if (next >= chunks.size() || chunks[next].size < need)
+        {
+            size_t size = chunkSize;
+            while (size < need)
+                size *= 2;
+            char *data = (char *)std::malloc(size);
+            if (!data)
+                throw std::bad_alloc();
+            chunks.insert(chunks.begin() + next, Chunk{data, size, 0});
+            stats.reserved += size;
+            if (chunkSize < maxChunkGrowth)
+                chunkSize *= 2; // few chunks for small scripts, bounded waste for large ones
+        }
+        current = next;
+        offset = 0;
+        return allocate(bytes, align);
+    }
+
+    void *do_allocate(size_t bytes, size_t align) override
+    {
+        return allocate(bytes, align);
+    }
+
+    void do_deallocate(void *, size_t, size_t) override
+    {
+        // freed in bulk by rewind(), reset() or release()
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    std::vector<Chunk> chunks;
+    size_t current = 0;
+    size_t offset = 0;
+    size_t chunkSize;
+    Stats stats;
+};
+
+// Parse-time structures: syntax tree nodes, their lists and literal text.
+// Freeing a whole program is astArena.release().
+Arena astArena;
+
+// Per-run scratch memory (call frames and argument lists).
+// Calls rewind it when they return; the driver resets it between statements.
+Arena scratchArena(16 * 1024);
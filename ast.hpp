@@ -0,0 +1,139 @@
+#pragma once
+#include <memory_resource>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "arena.hpp"
+#include "intern.hpp"
+
+// --- Syntax tree produced by the parser ---
+// The whole script is parsed once up front; every execution path walks
+// these nodes and never looks at source text again.
+// Nodes and their lists live in astArena; nodes are never destroyed one by one,
+// so every member is arena-backed or trivially destructible. Literal text views
+// the source buffer (or astArena), which must outlive the program.
+
+struct Expr;
+struct Stmt;
+using ExprPtr = Expr *;
+using StmtPtr = Stmt *;
+using Block = std::pmr::vector<StmtPtr>;
+
+// --- Spelling of a type keyword, as a static string ---
+inline std::string_view typeName(std::string_view spelled)
+{
+    for (std::string_view known : {"num", "str", "bool", "void"})
+        if (spelled == known)
+            return known;
+    return astArena.copy(spelled);
+}
+
+// --- Function argument representation ---
+struct FuncArg
+{
+    std::string_view type; // "num", "str", "bool"
+    Atom name = NoAtom;
+    int slot = -1;    // call frame slot, filled in by the resolver
+};
+
+// --- Frame a resolved slot lives in ---
+enum class SlotScope
+{
+    Global, // the global frame
+    Local   // the current call frame
+};
+
+enum class ExprKind
+{
+    Number,   // 3.5
+    String,   // "text" (endl is a String "\n")
+    Bool,     // true / false
+    Variable, // name
+    Call,     // name(args...)
+    Binary,   // lhs op rhs
+    Negate,   // -operand
+    Not,      // !operand
+    And,      // lhs && rhs (short-circuit)
+    Or,       // lhs || rhs (short-circuit)
+    Concat    // purr/str parts joined by '+'
+};
+
+enum class BinaryOp
+{
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Equal,
+    NotEqual,
+    Less,
+    Greater,
+    LessEqual,
+    GreaterEqual
+};
+
+struct Expr
+{
+    ExprKind kind;
+    int line = 0;
+    double number = 0;             // Number
+    bool boolean = false;          // Bool
+    std::string_view text;         // String value (in the source or astArena)
+    Atom name = NoAtom;            // Variable/Call name
+    int slot = -1;                 // Variable: frame slot (-1 = undefined), set by the resolver
+    SlotScope scope = SlotScope::Global;
+    bool numeric = false;          // statically never a str (set by the resolver)
+    BinaryOp op = BinaryOp::Add;   // Binary
+    std::pmr::vector<ExprPtr> operands{&astArena}; // Binary: lhs, rhs; Negate/Not: operand; And/Or: lhs, rhs; Call: args; Concat: parts
+    mutable const Stmt *cachedDef = nullptr; // Call: definition last called from here (see resolveCall)
+    mutable uint32_t cachedVersion = 0;      // Call: the function's version when cachedDef was looked up
+};
+
+enum class StmtKind
+{
+    Purr,     // purr ~> value;
+    Declare,  // type name ~> value;
+    Call,     // name(args);
+    If,       // if (value) { body } else { elseBody }
+    While,    // while (value) { body }; a for loop also has an init and a step
+    Return,   // return value;
+    Function  // type name(params) { body }
+};
+
+struct Stmt
+{
+    StmtKind kind;
+    int line = 0;
+    std::string_view type;       // Declare: variable type, Function: return type
+    Atom name = NoAtom;          // Declare: variable name, Function: function name
+    ExprPtr value = nullptr;     // Purr/Declare/Return value, Call expression, If condition
+    Block body{&astArena};       // If: taken branch, Function: body
+    Block elseBody{&astArena};   // If: else branch
+    StmtPtr init = nullptr;      // While (for loop): runs once before the first test
+    StmtPtr step = nullptr;      // While (for loop): runs after each pass through the body
+    std::pmr::vector<FuncArg> params{&astArena}; // Function
+    int slot = -1;               // Declare: frame slot of the variable
+    SlotScope scope = SlotScope::Global;
+    bool printsDirect = false;   // Purr: no calls, so it renders straight into the output buffer
+    bool declaredPure = false;   // Function: written with the pure modifier
+    bool pure = false;           // Function: result depends only on the arguments (set by the resolver)
+    int frameSize = 0;           // Function: parameter and local slots of a call frame
+    std::pmr::vector<std::pair<int, int>> globalSeeds{&astArena}; // Function: (local, global) slots of locals shadowing a global
+    mutable double (*jitEntry)(const double *args) = nullptr; // Function: native code once --jit compiled it (jit.hpp)
+    mutable uint32_t jitCalls = 0;                            // Function: calls counted towards the --jit threshold
+    mutable bool jitRejected = false;                         // Function: not compilable, stays interpreted
+};
+
+// a parsed script: top-level statements in source order
+using Program = Block;
+
+// --- Whether evaluating an expression can call a function ---
+inline bool containsCall(const Expr &expr)
+{
+    if (expr.kind == ExprKind::Call)
+        return true;
+    for (const ExprPtr &operand : expr.operands)
+        if (containsCall(*operand))
+            return true;
+    return false;
+}
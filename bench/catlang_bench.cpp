@@ -0,0 +1,302 @@
+// catlang_bench.cpp
+// Micro-benchmarks for the tree walker's hot paths.
+// Build from the repository root:
+//   g++ -std=c++17 -O2 -o catlang_bench bench/catlang_bench.cpp
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../output.hpp"
+#include "../source.hpp"
+#include "../intern.hpp"
+#include "../lexer.hpp"
+#include "../ast.hpp"
+#include "../parser.hpp"
+#include "../resolver.hpp"
+#include "../function.hpp"
+#include "../expressions.hpp"
+#include "../statements.hpp"
+#include "../fold.hpp"
+#include "../jit.hpp"
+
+using namespace std;
+
+// --- Allocation counter ---
+// Every operator new in the process is counted (the standard operator delete
+// releases it with free). The arenas take their chunks from malloc and reuse
+// them, so a steady-state operation only shows the allocations that escape
+// them (string bodies, std::string growth, ...).
+size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    ++allocations;
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+// --- Workloads ---
+// A workload is a script whose last top-level statement is the operation being
+// measured; everything before it runs once, as setup.
+struct Workload
+{
+    string name;
+    string text; // the parsed program views it, so it lives as long as the run
+};
+
+struct Result
+{
+    string name;
+    double nsPerOp = 0;
+    double opsPerSec = 0;
+    double allocsPerOp = 0;
+};
+
+// bench/purr.cat -> purr
+string workloadName(const string &path)
+{
+    size_t slash = path.find_last_of('/');
+    string name = slash == string::npos ? path : path.substr(slash + 1);
+    return name.substr(0, name.rfind(".cat"));
+}
+
+bool loadWorkload(const string &path, vector<Workload> &out)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+        return false;
+    ostringstream text;
+    text << file.rdbuf();
+    out.push_back({workloadName(path), text.str()});
+    return true;
+}
+
+// every .cat file of a directory, by name
+bool loadDirectory(const string &dir, vector<Workload> &out)
+{
+    DIR *handle = opendir(dir.c_str());
+    if (!handle)
+        return false;
+    vector<string> paths;
+    while (dirent *entry = readdir(handle))
+    {
+        string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".cat") == 0)
+            paths.push_back(dir + "/" + name);
+    }
+    closedir(handle);
+    sort(paths.begin(), paths.end());
+    for (const string &path : paths)
+        loadWorkload(path, out);
+    return true;
+}
+
+// purr over a template that reads three of n globals: the cost should not depend on n
+// (it did when purr substituted variables by scanning every global)
+Workload globalsWorkload(int n)
+{
+    string text;
+    for (int i = 0; i < n; ++i)
+        text += "num g" + to_string(i) + " ~> " + to_string(1000 + i) + ";\n";
+    text += "purr ~> \"a=\" + g0 + \" b=\" + g" + to_string(n / 2) + " + \" c=\" + g" + to_string(n - 1) + " + endl;\n";
+    return {"purr_globals_" + to_string(n), text};
+}
+
+// --- Measurement ---
+// The operation runs in batches that grow until one takes at least minSeconds;
+// the last batch is reported. Scratch memory is released after every operation,
+// as it is after every top-level statement of a script.
+bool measure(const Workload &workload, double minSeconds, Result &result)
+{
+    functions.clear();
+    globalFrame.clear();
+
+    size_t errorsBefore = errorsReported;
+    Program program = parseProgram(workload.text);
+    FrameLayout globals = resolveProgram(program);
+    optimizeProgram(program);
+    if (program.empty() || errorsReported != errorsBefore)
+    {
+        cerr << workload.name << ": the script has errors" << endl;
+        return false;
+    }
+    globalFrame.resize(globals.slots.size());
+    for (size_t i = 0; i + 1 < program.size(); ++i)
+        executeStatement(*program[i], globalFrame, nullptr);
+    const Stmt &operation = *program.back();
+
+    using Clock = chrono::steady_clock;
+    size_t n = 1;
+    for (;;)
+    {
+        size_t allocationsBefore = allocations;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; ++i)
+        {
+            executeStatement(operation, globalFrame, nullptr);
+            scratchArena.reset();
+        }
+        double seconds = chrono::duration<double>(Clock::now() - start).count();
+        if (seconds >= minSeconds || n >= ((size_t)1 << 40))
+        {
+            result.name = workload.name;
+            result.nsPerOp = seconds * 1e9 / n;
+            result.opsPerSec = seconds > 0 ? n / seconds : 0;
+            result.allocsPerOp = (double)(allocations - allocationsBefore) / n;
+            return true;
+        }
+        // aim a little past the target, growing by 2x to 100x per batch
+        size_t next = seconds > 0 ? (size_t)(minSeconds * 1.2 * n / seconds) : n * 100;
+        n = clamp(next, n * 2, n * 100);
+    }
+}
+
+// --- Report ---
+// One tab-separated line per workload, after a '#' header; a saved report is
+// read back as a baseline by --compare.
+void printHeader(bool comparing)
+{
+    cout << "# benchmark\tns/op\tops/s\tallocs/op" << (comparing ? "\tbaseline ns/op\tchange" : "") << "\n";
+}
+
+void printResult(const Result &result)
+{
+    cout << result.name << fixed << setprecision(2) << '\t' << result.nsPerOp << '\t' << setprecision(0) << result.opsPerSec
+         << '\t' << setprecision(2) << result.allocsPerOp;
+}
+
+// name -> ns/op from a saved report
+bool loadBaseline(const string &path, unordered_map<string, double> &baseline)
+{
+    ifstream file(path);
+    if (!file)
+        return false;
+    string line;
+    while (getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        istringstream fields(line);
+        string name;
+        double ns;
+        if (fields >> name >> ns)
+            baseline[name] = ns;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    initNativeStack();
+
+    double minSeconds = 0.2;
+    double threshold = 10; // percent slower than the baseline that counts as a regression
+    string baselinePath;
+    vector<string> inputs;
+    optimizationLevel = 0; // the workloads measure the evaluator, not what -O1 folds away
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg.rfind("--min-time=", 0) == 0 || arg.rfind("--threshold=", 0) == 0)
+        {
+            bool isTime = arg[2] == 'm';
+            size_t from = arg.find('=') + 1;
+            double value = 0;
+            auto [end, error] = from_chars(arg.data() + from, arg.data() + arg.size(), value);
+            if (error != errc() || end != arg.data() + arg.size() || value <= 0)
+            {
+                cerr << "Invalid " << arg.substr(0, from - 1) << ": " << arg.substr(from) << " (expected a positive number)" << endl;
+                return 1;
+            }
+            if (isTime)
+                minSeconds = value / 1000;
+            else
+                threshold = value;
+        }
+        else if (arg.rfind("--compare=", 0) == 0)
+            baselinePath = arg.substr(10);
+        else if (arg == "-O0" || arg == "-O1")
+            optimizationLevel = arg[2] - '0';
+        else if (arg.rfind("--", 0) == 0)
+        {
+            cerr << "Usage: catlang_bench [--min-time=ms] [--compare=baseline.txt] [--threshold=percent] [-O0|-O1]"
+                 << " [workload.cat|directory]..." << endl;
+            return 1;
+        }
+        else
+            inputs.push_back(arg);
+    }
+
+    vector<Workload> workloads;
+    if (inputs.empty())
+    {
+        if (!loadDirectory("bench", workloads))
+        {
+            cerr << "No workloads: run from the repository root or name .cat files" << endl;
+            return 1;
+        }
+        for (int n : {1, 16, 256})
+            workloads.push_back(globalsWorkload(n));
+    }
+    for (const string &input : inputs)
+    {
+        if (!loadDirectory(input, workloads) && !loadWorkload(input, workloads))
+        {
+            cerr << "Could not open " << input << endl;
+            return 1;
+        }
+    }
+
+    unordered_map<string, double> baseline;
+    bool comparing = !baselinePath.empty();
+    if (comparing && !loadBaseline(baselinePath, baseline))
+    {
+        cerr << "Could not read baseline: " << baselinePath << endl;
+        return 1;
+    }
+
+    // purr output is written (and discarded) exactly as a script's would be
+    output.fd = open("/dev/null", O_WRONLY);
+    output.policy = FlushPolicy::Full;
+
+    printHeader(comparing);
+    int regressions = 0;
+    for (const Workload &workload : workloads)
+    {
+        Result result;
+        if (!measure(workload, minSeconds, result))
+            return 1;
+        printResult(result);
+        if (comparing)
+        {
+            auto it = baseline.find(result.name);
+            if (it == baseline.end() || it->second <= 0)
+                cout << "\t-\tnew";
+            else
+            {
+                double change = 100 * (result.nsPerOp - it->second) / it->second;
+                cout << '\t' << setprecision(2) << it->second << '\t' << showpos << setprecision(1) << change << '%'
+                     << noshowpos;
+                if (change > threshold)
+                {
+                    cout << " slower";
+                    ++regressions;
+                }
+            }
+        }
+        cout << endl;
+    }
+    output.flush();
+    return regressions > 0 ? 1 : 0;
+}
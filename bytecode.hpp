@@ -0,0 +1,687 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include <iomanip>
+#include "ast.hpp"
+#include "function.hpp"
+#include "resolver.hpp"
+
+// --- Register bytecode ---
+// Every function (and the top-level script) compiles to a Proto: a flat list of
+// three-operand instructions over a window of registers. Parameters and locals
+// live in the low registers, temporaries above them. Globals are addressed by
+// slot index, functions by call-slot index, literals by constant index.
+enum class OpCode : uint8_t
+{
+    LoadK,     // R[a] = K[b]
+    LoadNil,   // R[a] = nothing
+    Move,      // R[a] = R[b]
+    LoadLocal, // R[a] = R[b], or K[c] (the local's name) while R[b] is unset: a local read by purr
+    GetGlobal, // R[a] = G[b]   (c = 1: inside purr, an unset global yields its name)
+    SetGlobal, // G[b] = R[a]
+    ToNum,     // R[a] = num(R[b])
+    ToStr,     // R[a] = str(R[b])
+    ToBool,    // R[a] = bool(R[b])
+    Add,       // R[a] = R[b] + R[c]  (joins text when either side is a str)
+    Sub,       // R[a] = R[b] - R[c]
+    Mul,       // R[a] = R[b] * R[c]
+    Div,       // R[a] = R[b] / R[c]
+    Neg,       // R[a] = -num(R[b])
+    Not,       // R[a] = !bool(R[b])
+    Concat,    // R[a] = str(R[b]) + str(R[c])
+    Eq,        // R[a] = R[b] == R[c]
+    Ne,        // R[a] = R[b] != R[c]
+    Lt,        // R[a] = R[b] <  R[c]
+    Gt,        // R[a] = R[b] >  R[c]
+    Le,        // R[a] = R[b] <= R[c]
+    Ge,        // R[a] = R[b] >= R[c]
+    BranchEq,  // if !(R[a] == R[b]) pc = c
+    BranchNe,  // if !(R[a] != R[b]) pc = c
+    BranchLt,  // if !(R[a] <  R[b]) pc = c
+    BranchGt,  // if !(R[a] >  R[b]) pc = c
+    BranchLe,  // if !(R[a] <= R[b]) pc = c
+    BranchGe,  // if !(R[a] >= R[b]) pc = c
+    JumpIfFalse, // if !bool(R[a]) pc = b
+    JumpIfTrue,  // if bool(R[a]) pc = b
+    Jump,      // pc = a
+    Call,      // R[a] = F[b](R[a], ..., R[a + c - 1])
+    TailCall,  // Call whose result is returned next; see VM::run
+    Return,    // return R[a]
+    Purr,      // print str(R[a])
+    PurrK,     // print K[a]
+    Define,    // F[a] = proto b
+    Halt
+};
+
+inline const char *opName(OpCode op)
+{
+    static const char *names[] = {
+        "LOADK", "LOADNIL", "MOVE", "LOADLOCAL", "GETGLOBAL", "SETGLOBAL", "TONUM", "TOSTR", "TOBOOL",
+        "ADD", "SUB", "MUL", "DIV", "NEG", "NOT", "CONCAT", "EQ", "NE", "LT", "GT", "LE", "GE",
+        "BRANCHEQ", "BRANCHNE", "BRANCHLT", "BRANCHGT", "BRANCHLE", "BRANCHGE",
+        "JUMPIFFALSE", "JUMPIFTRUE", "JUMP", "CALL", "TAILCALL", "RETURN", "PURR", "PURRK", "DEFINE", "HALT"};
+    return names[(int)op];
+}
+
+struct Instr
+{
+    OpCode op;
+    int32_t a = 0;
+    int32_t b = 0;
+    int32_t c = 0;
+};
+
+// --- One compiled function (protos[0] is the top-level script) ---
+struct Proto
+{
+    std::string name;
+    std::string returnType; // empty for the top-level script
+    std::vector<FuncArg> params;
+    std::vector<Instr> code;
+    std::vector<CatValue> constants;
+    int numRegs = 0;
+    bool pure = false;         // see memo.hpp
+    bool declaredPure = false; // written with the pure modifier
+};
+
+struct BytecodeProgram
+{
+    std::vector<Proto> protos;
+    std::vector<std::string> globalNames;   // global slot -> name
+    std::vector<std::string> functionNames; // call slot -> name
+};
+
+// --- AST -> bytecode ---
+struct Compiler
+{
+    BytecodeProgram &program;
+    std::unordered_map<Atom, int> globalIndex; // name -> resolver's global slot
+    std::unordered_map<Atom, int> functionIndex;
+
+    int current = 0;                             // proto being compiled
+    std::unordered_map<Atom, int> locals; // name -> register (inside functions)
+    int freeReg = 0;
+
+    // out may already hold compiled functions (restored from a snapshot); their
+    // call slots are kept and new code is added after them
+    Compiler(BytecodeProgram &out, const FrameLayout &globals) : program(out)
+    {
+        program.globalNames.clear();
+        for (const SlotInfo &slot : globals.slots)
+        {
+            globalIndex[slot.name] = (int)program.globalNames.size();
+            program.globalNames.push_back(atomName(slot.name));
+        }
+        for (size_t i = 0; i < program.functionNames.size(); ++i)
+            functionIndex[intern(program.functionNames[i])] = (int)i;
+        baseFunctions = program.functionNames.size();
+    }
+
+    // call slots that came with out; redefining one of them may change what a
+    // pure function from out computes, so those stop being pure
+    size_t baseFunctions = 0;
+
+    Proto &cur() { return program.protos[current]; }
+
+    // --- slot tables ---
+    int function(Atom name)
+    {
+        auto it = functionIndex.find(name);
+        if (it != functionIndex.end())
+            return it->second;
+        program.functionNames.push_back(atomName(name));
+        return functionIndex[name] = (int)program.functionNames.size() - 1;
+    }
+
+    int constant(const CatValue &value)
+    {
+        for (size_t i = 0; i < cur().constants.size(); ++i)
+            if (cur().constants[i].sameAs(value))
+                return (int)i;
+        cur().constants.push_back(value);
+        return (int)cur().constants.size() - 1;
+    }
+
+    int emit(OpCode op, int a = 0, int b = 0, int c = 0)
+    {
+        cur().code.push_back({op, a, b, c});
+        return (int)cur().code.size() - 1;
+    }
+
+    int here() { return (int)cur().code.size(); }
+
+    int allocReg()
+    {
+        int r = freeReg++;
+        if (freeReg > cur().numRegs)
+            cur().numRegs = freeReg;
+        return r;
+    }
+
+    static OpCode conversionFor(std::string_view type)
+    {
+        return type == "num" ? OpCode::ToNum : type == "str" ? OpCode::ToStr : OpCode::ToBool;
+    }
+
+    // true when the expression always yields the given type, so no conversion is needed
+    static bool producesType(const Expr &expr, std::string_view type)
+    {
+        switch (expr.kind)
+        {
+        case ExprKind::Number:
+        case ExprKind::Negate:
+            return type == "num";
+        case ExprKind::String:
+        case ExprKind::Concat:
+            return type == "str";
+        case ExprKind::Bool:
+        case ExprKind::Not:
+        case ExprKind::And:
+        case ExprKind::Or:
+            return type == "bool";
+        case ExprKind::Binary:
+            if (expr.op >= BinaryOp::Equal)
+                return type == "bool";
+            return type == "num" && (expr.op != BinaryOp::Add || expr.numeric); // '+' of a str joins text
+        default:
+            return false;
+        }
+    }
+
+    // --- Expressions ---
+    // Returns a register holding the value: a local's own register, or a fresh temporary.
+    int compileOperand(const Expr &expr, bool inPurr = false)
+    {
+        if (expr.kind == ExprKind::Variable)
+        {
+            auto it = locals.find(expr.name);
+            if (it != locals.end() && !inPurr)
+                return it->second;
+        }
+        int r = allocReg();
+        compileExprTo(expr, r, inPurr);
+        return r;
+    }
+
+    void compileExprTo(const Expr &expr, int dst, bool inPurr = false)
+    {
+        switch (expr.kind)
+        {
+        case ExprKind::Number:
+            emit(OpCode::LoadK, dst, constant(expr.number));
+            return;
+        case ExprKind::String:
+            emit(OpCode::LoadK, dst, constant(std::string(expr.text)));
+            return;
+        case ExprKind::Bool:
+            emit(OpCode::LoadK, dst, constant(expr.boolean));
+            return;
+
+        case ExprKind::Variable:
+        {
+            auto it = locals.find(expr.name);
+            if (it != locals.end() && inPurr)
+                emit(OpCode::LoadLocal, dst, it->second, constant(atomName(expr.name))); // unset prints its name
+            else if (it != locals.end())
+            {
+                if (it->second != dst)
+                    emit(OpCode::Move, dst, it->second);
+            }
+            else if (expr.slot >= 0 && expr.scope == SlotScope::Global)
+                emit(OpCode::GetGlobal, dst, expr.slot, inPurr ? 1 : 0);
+            else
+                emit(OpCode::LoadNil, dst); // undefined, already reported by the resolver
+            return;
+        }
+
+        case ExprKind::Call:
+        {
+            int saved = freeReg;
+            // a freshly allocated destination doubles as the argument base
+            int base = dst == freeReg - 1 ? dst : allocReg();
+            for (size_t i = 1; i < expr.operands.size(); ++i)
+                allocReg();
+            for (size_t i = 0; i < expr.operands.size(); ++i)
+            {
+                int argSaved = freeReg;
+                compileExprTo(*expr.operands[i], base + (int)i);
+                freeReg = argSaved;
+            }
+            emit(OpCode::Call, base, function(expr.name), (int)expr.operands.size());
+            if (base != dst)
+                emit(OpCode::Move, dst, base);
+            freeReg = saved;
+            return;
+        }
+
+        case ExprKind::Concat:
+        {
+            int saved = freeReg;
+            int acc = compileOperand(*expr.operands[0], inPurr);
+            for (size_t i = 1; i < expr.operands.size(); ++i)
+            {
+                int partSaved = freeReg;
+                int part = compileOperand(*expr.operands[i], inPurr);
+                // accumulate in dst only once the first two parts are joined
+                emit(OpCode::Concat, dst, acc, part);
+                acc = dst;
+                freeReg = partSaved;
+            }
+            freeReg = saved;
+            return;
+        }
+
+        case ExprKind::Negate:
+        case ExprKind::Not:
+        {
+            int saved = freeReg;
+            emit(expr.kind == ExprKind::Negate ? OpCode::Neg : OpCode::Not, dst, compileOperand(*expr.operands[0]));
+            freeReg = saved;
+            return;
+        }
+
+        case ExprKind::And:
+        case ExprKind::Or:
+        {
+            // short-circuit through jumps, then materialise the bool
+            std::vector<int> toFalse;
+            compileCondJump(expr, false, toFalse);
+            emit(OpCode::LoadK, dst, constant(true));
+            int toEnd = emit(OpCode::Jump, -1);
+            for (int jump : toFalse)
+                patchJump(jump, here());
+            emit(OpCode::LoadK, dst, constant(false));
+            patchJump(toEnd, here());
+            return;
+        }
+
+        case ExprKind::Binary:
+        {
+            int saved = freeReg;
+            int lhs = compileOperand(*expr.operands[0]);
+            int rhs = compileOperand(*expr.operands[1]);
+            static const OpCode ops[] = {OpCode::Add, OpCode::Sub, OpCode::Mul, OpCode::Div, OpCode::Eq,
+                                         OpCode::Ne, OpCode::Lt, OpCode::Gt, OpCode::Le, OpCode::Ge};
+            emit(ops[(int)expr.op], dst, lhs, rhs);
+            freeReg = saved;
+            return;
+        }
+        }
+    }
+
+    // Emits jumps taken when the condition's truth equals jumpIf and adds them
+    // to jumps for patching; otherwise execution falls through. && and ||
+    // short-circuit: the right side is skipped once the result is known.
+    void compileCondJump(const Expr &cond, bool jumpIf, std::vector<int> &jumps)
+    {
+        switch (cond.kind)
+        {
+        case ExprKind::Not:
+            compileCondJump(*cond.operands[0], !jumpIf, jumps);
+            return;
+        case ExprKind::And:
+        case ExprKind::Or:
+        {
+            // jumpIf == false for && (or true for ||): either side decides on its own
+            bool isAnd = cond.kind == ExprKind::And;
+            if (jumpIf != isAnd)
+            {
+                compileCondJump(*cond.operands[0], jumpIf, jumps);
+                compileCondJump(*cond.operands[1], jumpIf, jumps);
+                return;
+            }
+            // otherwise a deciding left side skips the right one
+            std::vector<int> skip;
+            compileCondJump(*cond.operands[0], !jumpIf, skip);
+            compileCondJump(*cond.operands[1], jumpIf, jumps);
+            for (int jump : skip)
+                patchJump(jump, here());
+            return;
+        }
+        default:
+            break;
+        }
+
+        int saved = freeReg;
+        if (!jumpIf && cond.kind == ExprKind::Binary && cond.op >= BinaryOp::Equal)
+        {
+            // comparisons become a single compare-and-branch
+            int lhs = compileOperand(*cond.operands[0]);
+            int rhs = compileOperand(*cond.operands[1]);
+            static const OpCode ops[] = {OpCode::BranchEq, OpCode::BranchNe, OpCode::BranchLt,
+                                         OpCode::BranchGt, OpCode::BranchLe, OpCode::BranchGe};
+            jumps.push_back(emit(ops[(int)cond.op - (int)BinaryOp::Equal], lhs, rhs, -1));
+        }
+        else
+        {
+            int r = compileOperand(cond);
+            jumps.push_back(emit(jumpIf ? OpCode::JumpIfTrue : OpCode::JumpIfFalse, r, -1));
+        }
+        freeReg = saved;
+    }
+
+    void patchJump(int at, int target)
+    {
+        Instr &ins = cur().code[at];
+        if (ins.op == OpCode::Jump)
+            ins.a = target;
+        else if (ins.op == OpCode::JumpIfFalse || ins.op == OpCode::JumpIfTrue)
+            ins.b = target;
+        else
+            ins.c = target;
+    }
+
+    // --- Statements ---
+    void compileBlock(const Block &block)
+    {
+        for (const StmtPtr &stmt : block)
+            compileStatement(*stmt);
+    }
+
+    void compileStatement(const Stmt &stmt)
+    {
+        int saved = freeReg;
+        switch (stmt.kind)
+        {
+        case StmtKind::Purr:
+        {
+            const Expr &value = *stmt.value;
+            if (value.kind == ExprKind::Concat && !containsCall(value))
+            {
+                // no side effects between parts: print each part straight away
+                for (const ExprPtr &part : value.operands)
+                    compilePurrPart(*part);
+            }
+            else if (value.kind != ExprKind::Concat)
+                compilePurrPart(value);
+            else
+            {
+                int r = allocReg();
+                compileExprTo(value, r, true);
+                emit(OpCode::Purr, r);
+            }
+            break;
+        }
+
+        case StmtKind::Declare:
+        {
+            auto it = locals.find(stmt.name);
+            bool typed = producesType(*stmt.value, stmt.type);
+            if (it != locals.end() && typed && stmt.value->kind != ExprKind::Concat)
+            {
+                // computed straight into the local: its register is written after every operand is read
+                compileExprTo(*stmt.value, it->second);
+                break;
+            }
+            int tmp = allocReg();
+            compileExprTo(*stmt.value, tmp);
+            if (it != locals.end())
+                emit(typed ? OpCode::Move : conversionFor(stmt.type), it->second, tmp);
+            else
+            {
+                if (!typed)
+                    emit(conversionFor(stmt.type), tmp, tmp);
+                emit(OpCode::SetGlobal, tmp, stmt.slot);
+            }
+            break;
+        }
+
+        case StmtKind::Call:
+            compileExprTo(*stmt.value, allocReg());
+            break;
+
+        case StmtKind::If:
+        {
+            std::vector<int> toElse;
+            compileCondJump(*stmt.value, false, toElse);
+            compileBlock(stmt.body);
+            int toEnd = stmt.elseBody.empty() ? -1 : emit(OpCode::Jump, -1);
+            for (int jump : toElse)
+                patchJump(jump, here());
+            if (toEnd >= 0)
+            {
+                compileBlock(stmt.elseBody);
+                patchJump(toEnd, here());
+            }
+            break;
+        }
+
+        case StmtKind::While:
+        {
+            // init; top: test -> exit; body; step; jump top
+            if (stmt.init)
+                compileStatement(*stmt.init);
+            int top = here();
+            std::vector<int> toExit;
+            compileCondJump(*stmt.value, false, toExit);
+            compileBlock(stmt.body);
+            if (stmt.step)
+                compileStatement(*stmt.step);
+            emit(OpCode::Jump, top);
+            for (int jump : toExit)
+                patchJump(jump, here());
+            break;
+        }
+
+        case StmtKind::Return:
+        {
+            int r = allocReg();
+            if (stmt.value)
+            {
+                compileExprTo(*stmt.value, r);
+                // the call's result is returned as is: let the VM reuse this frame
+                if (stmt.value->kind == ExprKind::Call && cur().code.back().op == OpCode::Call && cur().code.back().a == r)
+                    cur().code.back().op = OpCode::TailCall;
+            }
+            else
+                emit(OpCode::LoadNil, r);
+            if (cur().returnType != "void")
+                emit(conversionFor(cur().returnType), r, r);
+            emit(OpCode::Return, r);
+            break;
+        }
+
+        case StmtKind::Function:
+            emit(OpCode::Define, function(stmt.name), compileFunction(stmt));
+            break;
+        }
+        freeReg = saved;
+    }
+
+    void compilePurrPart(const Expr &part)
+    {
+        switch (part.kind)
+        {
+        case ExprKind::String:
+            emit(OpCode::PurrK, constant(std::string(part.text)));
+            return;
+        case ExprKind::Number:
+            emit(OpCode::PurrK, constant(formatNumber(part.number)));
+            return;
+        case ExprKind::Bool:
+            emit(OpCode::PurrK, constant(std::string(part.boolean ? "true" : "false")));
+            return;
+        default:
+            break;
+        }
+        int saved = freeReg;
+        emit(OpCode::Purr, compileOperand(part, true));
+        freeReg = saved;
+    }
+
+    // Compiles a function body into a new proto and returns its index.
+    int compileFunction(const Stmt &stmt)
+    {
+        if ((size_t)function(stmt.name) < baseFunctions)
+        {
+            for (Proto &proto : program.protos)
+                proto.pure = false;
+            baseFunctions = 0;
+        }
+        int index = (int)program.protos.size();
+        program.protos.emplace_back();
+        int outer = current;
+        auto outerLocals = std::move(locals);
+        int outerFree = freeReg;
+
+        current = index;
+        cur().name = atomName(stmt.name);
+        cur().returnType = stmt.type;
+        cur().params.assign(stmt.params.begin(), stmt.params.end());
+        cur().pure = stmt.pure;
+        cur().declaredPure = stmt.declaredPure;
+        locals.clear();
+        freeReg = 0;
+
+        // parameters first, then every name the body declares
+        for (const FuncArg &param : stmt.params)
+            if (!locals.count(param.name))
+                locals[param.name] = allocReg();
+        for (const FuncArg &param : stmt.params)
+            emit(conversionFor(param.type), locals[param.name], locals[param.name]);
+        std::vector<const Stmt *> declared;
+        Resolver::collectDeclarationStmts(stmt.body, declared);
+        for (const Stmt *decl : declared)
+        {
+            if (locals.count(decl->name))
+                continue;
+            int r = locals[decl->name] = allocReg();
+            // a local shadowing a global starts out with the global's value
+            auto git = globalIndex.find(decl->name);
+            if (git != globalIndex.end())
+                emit(OpCode::GetGlobal, r, git->second);
+        }
+
+        compileBlock(stmt.body);
+
+        // falling off the end returns the type's default
+        int r = allocReg();
+        emit(OpCode::LoadNil, r);
+        if (stmt.type != "void")
+            emit(conversionFor(stmt.type), r, r);
+        emit(OpCode::Return, r);
+
+        current = outer;
+        locals = std::move(outerLocals);
+        freeReg = outerFree;
+        return index;
+    }
+
+    void compileProgram(const Program &ast)
+    {
+        if (program.protos.empty())
+            program.protos.emplace_back();
+        program.protos[0] = Proto();
+        program.protos[0].name = "<main>";
+        current = 0;
+        for (const StmtPtr &stmt : ast)
+            compileStatement(*stmt);
+        emit(OpCode::Halt);
+    }
+};
+
+// base: functions compiled earlier that the program may call (see snapshot.hpp)
+inline BytecodeProgram compileToBytecode(const Program &ast, const FrameLayout &globals, BytecodeProgram base = BytecodeProgram())
+{
+    BytecodeProgram program = std::move(base);
+    Compiler compiler(program, globals);
+    compiler.compileProgram(ast);
+    return program;
+}
+
+// --- Human-readable listing for --dump-bytecode ---
+inline std::string describeConstant(const CatValue &value)
+{
+    if (value.isString())
+    {
+        std::string out = "\"";
+        for (char ch : value.asString())
+            out += ch == '\n' ? std::string("\\n") : std::string(1, ch);
+        return out + "\"";
+    }
+    return toText(value);
+}
+
+inline void dumpBytecode(const BytecodeProgram &program, std::ostream &out)
+{
+    for (const Proto &proto : program.protos)
+    {
+        if (proto.returnType.empty())
+            out << "script " << proto.name;
+        else
+        {
+            out << "function " << proto.returnType << " " << proto.name << "(";
+            for (size_t i = 0; i < proto.params.size(); ++i)
+                out << (i ? ", " : "") << proto.params[i].type << " " << atomName(proto.params[i].name);
+            out << ")";
+        }
+        out << "  [" << proto.numRegs << " registers, " << proto.constants.size() << " constants]\n";
+
+        for (size_t pc = 0; pc < proto.code.size(); ++pc)
+        {
+            const Instr &ins = proto.code[pc];
+            out << "  " << std::setw(4) << pc << "  " << std::left << std::setw(12) << opName(ins.op) << std::right;
+            switch (ins.op)
+            {
+            case OpCode::LoadK:
+                out << "r" << ins.a << " k" << ins.b << "  ; " << describeConstant(proto.constants[ins.b]);
+                break;
+            case OpCode::LoadNil:
+            case OpCode::Purr:
+            case OpCode::Return:
+                out << "r" << ins.a;
+                break;
+            case OpCode::Move:
+            case OpCode::Neg:
+            case OpCode::Not:
+            case OpCode::ToNum:
+            case OpCode::ToStr:
+            case OpCode::ToBool:
+                out << "r" << ins.a << " r" << ins.b;
+                break;
+            case OpCode::LoadLocal:
+                out << "r" << ins.a << " r" << ins.b << " k" << ins.c << "  ; " << describeConstant(proto.constants[ins.c]);
+                break;
+            case OpCode::GetGlobal:
+            case OpCode::SetGlobal:
+                out << "r" << ins.a << " g" << ins.b << "  ; " << program.globalNames[ins.b];
+                break;
+            case OpCode::BranchEq:
+            case OpCode::BranchNe:
+            case OpCode::BranchLt:
+            case OpCode::BranchGt:
+            case OpCode::BranchLe:
+            case OpCode::BranchGe:
+                out << "r" << ins.a << " r" << ins.b << " -> " << ins.c;
+                break;
+            case OpCode::JumpIfFalse:
+            case OpCode::JumpIfTrue:
+                out << "r" << ins.a << " -> " << ins.b;
+                break;
+            case OpCode::Jump:
+                out << "-> " << ins.a;
+                break;
+            case OpCode::Call:
+            case OpCode::TailCall:
+                out << "r" << ins.a << " f" << ins.b << " " << ins.c << "  ; " << program.functionNames[ins.b];
+                break;
+            case OpCode::PurrK:
+                out << "k" << ins.a << "  ; " << describeConstant(proto.constants[ins.a]);
+                break;
+            case OpCode::Define:
+                out << "f" << ins.a << " proto " << ins.b << "  ; " << program.functionNames[ins.a];
+                break;
+            case OpCode::Halt:
+                break;
+            default:
+                out << "r" << ins.a << " r" << ins.b << " r" << ins.c;
+                break;
+            }
+            out << "\n";
+        }
+        out << "\n";
+    }
+}
@@ -0,0 +1,431 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "bytecode.hpp"
+#include "source.hpp"
+
+// --- Compiled-script cache (.catc) ---
+// The bytecode of a script is saved after a clean compile and mapped back in on
+// later runs, skipping lexing, parsing, resolution and compilation. A cache file
+// is keyed by the script's content hash and size, the optimization level it was
+// compiled at, the bytecode format version and the interpreter build that wrote
+// it; anything that does not match (or is truncated, or refers to a register,
+// constant, slot or jump target that does not exist) is ignored and the script
+// is compiled again.
+//
+// Layout, little-endian, no padding:
+//   "CATC" u32 version u64 build u64 hash u64 size u8 optimization level
+//   names:  u32 count, strings          (global slots, then call slots)
+//   protos: u32 count, each: name, return type, u32 registers, u8 pure, u8 declared pure,
+//           u32 params (type, name, i32 slot), u32 constants (u8 tag, payload),
+//           u32 instructions (u8 op, i32 a, i32 b, i32 c)
+// Strings are a u32 length and the bytes.
+
+// Bump whenever the opcodes, their operands or this layout change.
+const uint32_t bytecodeVersion = 4;
+
+// --- 64-bit FNV-1a of the script text ---
+inline uint64_t hashSource(std::string_view text)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : text)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Identifies the interpreter binary, so a file written by another build (whose
+// compiler may differ in ways bytecodeVersion was not bumped for) is not trusted.
+const uint64_t interpreterBuild = hashSource(__DATE__ " " __TIME__ " " __VERSION__);
+
+// --- Where the cache of a script lives ---
+// Next to the script (hello.cat -> hello.catc), or in cacheDir named by the content hash.
+inline std::string cachePathFor(const std::string &script, const std::string &cacheDir, uint64_t hash)
+{
+    if (!cacheDir.empty())
+    {
+        char name[32];
+        std::snprintf(name, sizeof name, "%016llx.catc", (unsigned long long)hash);
+        return cacheDir + (cacheDir.back() == '/' ? "" : "/") + name;
+    }
+    std::string base = script;
+    for (const char *ext : {".catlang", ".cat"})
+    {
+        size_t len = std::strlen(ext);
+        if (base.size() >= len && base.compare(base.size() - len, len, ext) == 0)
+        {
+            base.erase(base.size() - len);
+            break;
+        }
+    }
+    return base + ".catc";
+}
+
+// --- Writing ---
+struct CacheWriter
+{
+    std::string out;
+
+    void bytes(const void *data, size_t size) { out.append((const char *)data, size); }
+    void u8(uint8_t value) { bytes(&value, 1); }
+    void u32(uint32_t value) { bytes(&value, 4); }
+    void i32(int32_t value) { bytes(&value, 4); }
+    void u64(uint64_t value) { bytes(&value, 8); }
+
+    void str(std::string_view text)
+    {
+        u32((uint32_t)text.size());
+        bytes(text.data(), text.size());
+    }
+
+    void value(const CatValue &value)
+    {
+        u8((uint8_t)value.type());
+        switch (value.type())
+        {
+        case CatValue::Tag::Num:
+        {
+            double num = value.asNumber();
+            bytes(&num, 8);
+            break;
+        }
+        case CatValue::Tag::Bool:
+            u8(value.asBool());
+            break;
+        case CatValue::Tag::Str:
+            str(value.asString());
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+// --- Bytecode: slot names and protos ---
+inline void writeProgram(CacheWriter &w, const BytecodeProgram &program)
+{
+    w.u32((uint32_t)program.globalNames.size());
+    for (const std::string &name : program.globalNames)
+        w.str(name);
+    w.u32((uint32_t)program.functionNames.size());
+    for (const std::string &name : program.functionNames)
+        w.str(name);
+
+    w.u32((uint32_t)program.protos.size());
+    for (const Proto &proto : program.protos)
+    {
+        w.str(proto.name);
+        w.str(proto.returnType);
+        w.u32((uint32_t)proto.numRegs);
+        w.u8(proto.pure);
+        w.u8(proto.declaredPure);
+        w.u32((uint32_t)proto.params.size());
+        for (const FuncArg &param : proto.params)
+        {
+            w.str(param.type);
+            w.str(atomName(param.name));
+            w.i32(param.slot);
+        }
+        w.u32((uint32_t)proto.constants.size());
+        for (const CatValue &constant : proto.constants)
+            w.value(constant);
+        w.u32((uint32_t)proto.code.size());
+        for (const Instr &ins : proto.code)
+        {
+            w.u8((uint8_t)ins.op);
+            w.i32(ins.a);
+            w.i32(ins.b);
+            w.i32(ins.c);
+        }
+    }
+}
+
+// Written to a temporary file and renamed into place, so concurrent runs never
+// see a half-written file.
+inline bool writeFileAtomically(const std::string &path, const std::string &data)
+{
+    std::string temp = path + ".tmp" + std::to_string(getpid());
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    size_t done = 0;
+    while (done < data.size())
+    {
+        ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+        if (n <= 0)
+            break;
+        done += (size_t)n;
+    }
+    ::close(fd);
+    if (done != data.size() || std::rename(temp.c_str(), path.c_str()) != 0)
+    {
+        ::unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// the four-byte magic, the format version and the build, read back by readHeader
+inline void writeHeader(CacheWriter &w, const char *magic)
+{
+    w.bytes(magic, 4);
+    w.u32(bytecodeVersion);
+    w.u64(interpreterBuild);
+}
+
+// Failing to write the cache is not an error: the run goes on without it.
+inline void saveBytecodeCache(const std::string &path, uint64_t hash, uint64_t size, uint8_t level, const BytecodeProgram &program)
+{
+    CacheWriter w;
+    writeHeader(w, "CATC");
+    w.u64(hash);
+    w.u64(size);
+    w.u8(level);
+    writeProgram(w, program);
+    writeFileAtomically(path, w.out);
+}
+
+// --- Reading ---
+// Every read is bounds-checked; a short or malformed file just sets ok = false.
+struct CacheReader
+{
+    const char *at;
+    const char *end;
+    bool ok = true;
+
+    bool take(void *data, size_t size)
+    {
+        if (!ok || (size_t)(end - at) < size)
+            return ok = false;
+        std::memcpy(data, at, size);
+        at += size;
+        return true;
+    }
+
+    uint8_t u8()
+    {
+        uint8_t value = 0;
+        take(&value, 1);
+        return value;
+    }
+
+    uint32_t u32()
+    {
+        uint32_t value = 0;
+        take(&value, 4);
+        return value;
+    }
+
+    int32_t i32()
+    {
+        int32_t value = 0;
+        take(&value, 4);
+        return value;
+    }
+
+    uint64_t u64()
+    {
+        uint64_t value = 0;
+        take(&value, 8);
+        return value;
+    }
+
+    std::string_view str()
+    {
+        uint32_t size = u32();
+        if (!ok || (size_t)(end - at) < size)
+        {
+            ok = false;
+            return std::string_view();
+        }
+        std::string_view text(at, size);
+        at += size;
+        return text;
+    }
+
+    // a count of items that each take at least minSize bytes, checked against what is left
+    uint32_t count(size_t minSize)
+    {
+        uint32_t n = u32();
+        if (ok && (size_t)(end - at) / minSize < n)
+            ok = false;
+        return ok ? n : 0;
+    }
+
+    CatValue value()
+    {
+        switch ((CatValue::Tag)u8())
+        {
+        case CatValue::Tag::Num:
+        {
+            double num = 0;
+            take(&num, 8);
+            return num;
+        }
+        case CatValue::Tag::Bool:
+            return u8() != 0;
+        case CatValue::Tag::Str:
+            return std::string(str());
+        case CatValue::Tag::Nil:
+            return CatValue();
+        }
+        ok = false;
+        return CatValue();
+    }
+};
+
+// --- Operand checks ---
+// The VM indexes its tables with instruction operands unchecked, so a loaded
+// program must not refer to anything that does not exist: every register is
+// below the proto's numRegs, constants, globals, call slots and protos are in
+// range, jumps land inside the code, and the code cannot run off its end.
+inline bool validInstruction(const Instr &ins, const Proto &proto, const BytecodeProgram &program)
+{
+    auto reg = [&](int r) { return r >= 0 && r < proto.numRegs; };
+    auto constant = [&](int k) { return k >= 0 && (size_t)k < proto.constants.size(); };
+    auto target = [&](int pc) { return pc >= 0 && (size_t)pc < proto.code.size(); };
+    auto global = [&](int g) { return g >= 0 && (size_t)g < program.globalNames.size(); };
+    auto function = [&](int f) { return f >= 0 && (size_t)f < program.functionNames.size(); };
+
+    switch (ins.op)
+    {
+    case OpCode::LoadK:
+        return reg(ins.a) && constant(ins.b);
+    case OpCode::LoadNil:
+    case OpCode::Return:
+    case OpCode::Purr:
+        return reg(ins.a);
+    case OpCode::Move:
+    case OpCode::ToNum:
+    case OpCode::ToStr:
+    case OpCode::ToBool:
+    case OpCode::Neg:
+    case OpCode::Not:
+        return reg(ins.a) && reg(ins.b);
+    case OpCode::LoadLocal:
+        return reg(ins.a) && reg(ins.b) && constant(ins.c) && proto.constants[ins.c].isString();
+    case OpCode::GetGlobal:
+    case OpCode::SetGlobal:
+        return reg(ins.a) && global(ins.b);
+    case OpCode::JumpIfFalse:
+    case OpCode::JumpIfTrue:
+        return reg(ins.a) && target(ins.b);
+    case OpCode::Jump:
+        return target(ins.a);
+    case OpCode::Call:
+    case OpCode::TailCall:
+        // the arguments are R[a .. a+c-1]; the result goes to R[a]
+        return reg(ins.a) && function(ins.b) && ins.c >= 0 && ins.c <= proto.numRegs - ins.a;
+    case OpCode::PurrK:
+        return constant(ins.a) && proto.constants[ins.a].isString();
+    case OpCode::Define:
+        return function(ins.a) && ins.b > 0 && (size_t)ins.b < program.protos.size();
+    case OpCode::Halt:
+        return true;
+    default:
+        break;
+    }
+    if (ins.op >= OpCode::BranchEq && ins.op <= OpCode::BranchGe)
+        return reg(ins.a) && reg(ins.b) && target(ins.c);
+    // arithmetic, Concat and comparisons: R[a] = R[b] op R[c]
+    return reg(ins.a) && reg(ins.b) && reg(ins.c);
+}
+
+inline bool validProgram(const BytecodeProgram &program)
+{
+    for (size_t i = 0; i < program.protos.size(); ++i)
+    {
+        const Proto &proto = program.protos[i];
+        if (proto.numRegs < 0 || proto.params.size() > (size_t)proto.numRegs)
+            return false;
+        // only the snapshot's emptied top-level proto has no code
+        if (proto.code.empty())
+        {
+            if (i == 0)
+                continue;
+            return false;
+        }
+        OpCode last = proto.code.back().op;
+        if (last != OpCode::Return && last != OpCode::Halt && last != OpCode::Jump)
+            return false;
+        for (const Instr &ins : proto.code)
+        {
+            if (!validInstruction(ins, proto, program))
+                return false;
+        }
+    }
+    return true;
+}
+
+inline bool readProgram(CacheReader &r, BytecodeProgram &program)
+{
+    for (uint32_t n = r.count(4); n > 0; --n)
+        program.globalNames.emplace_back(r.str());
+    for (uint32_t n = r.count(4); n > 0; --n)
+        program.functionNames.emplace_back(r.str());
+
+    for (uint32_t n = r.count(16); n > 0 && r.ok; --n)
+    {
+        Proto &proto = program.protos.emplace_back();
+        proto.name = r.str();
+        proto.returnType = r.str();
+        proto.numRegs = (int)r.u32();
+        proto.pure = r.u8() != 0;
+        proto.declaredPure = r.u8() != 0;
+        for (uint32_t p = r.count(12); p > 0; --p)
+        {
+            FuncArg param;
+            param.type = typeName(r.str());
+            param.name = intern(r.str());
+            param.slot = r.i32();
+            proto.params.push_back(param);
+        }
+        for (uint32_t k = r.count(1); k > 0; --k)
+            proto.constants.push_back(r.value());
+        proto.code.resize(r.count(13));
+        for (Instr &ins : proto.code)
+        {
+            uint8_t op = r.u8();
+            if (op > (uint8_t)OpCode::Halt)
+                r.ok = false;
+            ins.op = (OpCode)op;
+            ins.a = r.i32();
+            ins.b = r.i32();
+            ins.c = r.i32();
+        }
+    }
+    return r.ok && !program.protos.empty() && validProgram(program);
+}
+
+// checks the four-byte magic, the format version and the build at the start of a file
+inline bool readHeader(CacheReader &r, const char *magic)
+{
+    char found[4] = {};
+    r.take(found, 4);
+    return r.ok && std::memcmp(found, magic, 4) == 0 && r.u32() == bytecodeVersion && r.u64() == interpreterBuild;
+}
+
+// true when path holds the cache for exactly this script; program is then filled in
+inline bool loadBytecodeCache(const std::string &path, uint64_t hash, uint64_t size, uint8_t level, BytecodeProgram &program)
+{
+    SourceFile file;
+    if (!file.open(path))
+        return false;
+    CacheReader r{file.data, file.data + file.size};
+    BytecodeProgram loaded;
+    if (!readHeader(r, "CATC") || r.u64() != hash || r.u64() != size || r.u8() != level ||
+        !readProgram(r, loaded) || r.at != r.end)
+        return false;
+    if (loaded.protos[0].code.empty()) // only a snapshot leaves the top level empty
+        return false;
+    program = std::move(loaded);
+    return true;
+}
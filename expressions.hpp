@@ -0,0 +1,336 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <iostream>
+#include "ast.hpp"
+#include "function.hpp"
+#include "memo.hpp"
+#include "output.hpp"
+
+CatValue evaluate(const Expr &expr, Frame &frame);
+double evalNumber(const Expr &expr, Frame &frame);
+bool evalBool(const Expr &expr, Frame &frame);
+
+// --- Definition a call expression refers to, through its call-site cache ---
+// Null while the function is undefined.
+inline const Stmt *resolveCall(const Expr &call)
+{
+    if (call.cachedDef && (size_t)call.name < functions.size() && functions[call.name].version == call.cachedVersion)
+    {
+        ++callCacheHits;
+        return call.cachedDef;
+    }
+    ++callCacheMisses;
+    const CatFunction *func = findFunction(call.name);
+    call.cachedDef = func ? func->def : nullptr;
+    call.cachedVersion = func ? func->version : 0;
+    return call.cachedDef;
+}
+
+// --- Run a definition with evaluated arguments (memo cache, depth limit) ---
+inline CatValue invokeFunction(const Stmt *def, std::pmr::vector<CatValue> &args)
+{
+    // a memoized function is looked up by its definition and argument values
+    std::string key;
+    bool memo = memoizes(def->pure, def->declaredPure);
+    if (memo)
+    {
+        MemoCache::makeKey(key, (uintptr_t)def, args.data(), args.size());
+        if (const CatValue *cached = memoCache.find(key))
+            return *cached;
+    }
+    enterCall();
+    CatValue result = executeFunction(CatFunction{def}, args);
+    leaveCall();
+    if (memo)
+        memoCache.insert(std::move(key), result);
+    return result;
+}
+
+// --- Call a function by name with already-parsed argument expressions ---
+inline CatValue callFunction(const Expr &call, Frame &frame)
+{
+    const Stmt *def = resolveCall(call);
+    if (!def)
+    {
+        // the arguments still run first, as on the VM
+        for (const ExprPtr &arg : call.operands)
+            evaluate(*arg, frame);
+        errorStream() << "Undefined function: " << atomName(call.name) << std::endl;
+        return CatValue();
+    }
+
+    // arguments and the callee's frame are scratch memory, dropped on return
+    Arena::Mark mark = scratchArena.mark();
+    CatValue result;
+    {
+        std::pmr::vector<CatValue> args(&scratchArena);
+        args.reserve(call.operands.size());
+        for (const ExprPtr &arg : call.operands)
+            args.push_back(evaluate(*arg, frame));
+        result = invokeFunction(def, args);
+    }
+    scratchArena.rewind(mark);
+    return result;
+}
+
+// --- `return f(...)`: evaluate the arguments and leave the call to executeFunction ---
+// False when f is undefined; the ordinary call then reports it.
+inline bool prepareTailCall(const Expr &call, Frame &frame)
+{
+    const Stmt *def = resolveCall(call);
+    if (!def)
+        return false;
+    std::vector<CatValue> args;
+    args.reserve(call.operands.size());
+    for (const ExprPtr &arg : call.operands)
+        args.push_back(evaluate(*arg, frame));
+    pendingTailCall.def = def;
+    pendingTailCall.args.swap(args);
+    return true;
+}
+
+// --- Numeric comparison ---
+inline bool compareNumbers(BinaryOp op, double l, double r)
+{
+    switch (op)
+    {
+    case BinaryOp::Equal:
+        return l == r;
+    case BinaryOp::NotEqual:
+        return l != r;
+    case BinaryOp::Less:
+        return l < r;
+    case BinaryOp::Greater:
+        return l > r;
+    case BinaryOp::LessEqual:
+        return l <= r;
+    case BinaryOp::GreaterEqual:
+        return l >= r;
+    default:
+        return false;
+    }
+}
+
+// --- Comparison of two values ---
+// Two strings compare as text, anything else compares numerically.
+inline bool compareValues(BinaryOp op, const CatValue &lhs, const CatValue &rhs)
+{
+    if (lhs.isString() && rhs.isString())
+    {
+        int c = lhs.asString().compare(rhs.asString());
+        switch (op)
+        {
+        case BinaryOp::Equal:
+            return c == 0;
+        case BinaryOp::NotEqual:
+            return c != 0;
+        case BinaryOp::Less:
+            return c < 0;
+        case BinaryOp::Greater:
+            return c > 0;
+        case BinaryOp::LessEqual:
+            return c <= 0;
+        case BinaryOp::GreaterEqual:
+            return c >= 0;
+        default:
+            return false;
+        }
+    }
+
+    return compareNumbers(op, toNumber(lhs), toNumber(rhs));
+}
+
+// --- Frame holding a resolved variable ---
+inline Frame &frameFor(SlotScope scope, Frame &frame)
+{
+    return scope == SlotScope::Global ? globalFrame : frame;
+}
+
+// --- Evaluate an expression tree ---
+CatValue evaluate(const Expr &expr, Frame &frame)
+{
+    switch (expr.kind)
+    {
+    case ExprKind::Number:
+        return expr.number;
+    case ExprKind::String:
+        return std::string(expr.text);
+    case ExprKind::Bool:
+        return expr.boolean;
+
+    case ExprKind::Variable:
+        // undefined names were reported by the resolver and have no slot
+        return expr.slot < 0 ? CatValue() : frameFor(expr.scope, frame)[expr.slot];
+
+    case ExprKind::Call:
+        return callFunction(expr, frame);
+
+    case ExprKind::Concat:
+    {
+        std::string out;
+        for (const ExprPtr &part : expr.operands)
+            appendText(out, evaluate(*part, frame));
+        return out;
+    }
+
+    case ExprKind::Negate:
+        return evalNumber(expr, frame);
+    case ExprKind::Not:
+    case ExprKind::And:
+    case ExprKind::Or:
+        return evalBool(expr, frame);
+
+    case ExprKind::Binary:
+    {
+        if (expr.op == BinaryOp::Add && !expr.numeric)
+        {
+            // '+' with a string operand joins text, like purr does
+            CatValue lhs = evaluate(*expr.operands[0], frame);
+            CatValue rhs = evaluate(*expr.operands[1], frame);
+            if (lhs.isString() || rhs.isString())
+            {
+                std::string text;
+                appendText(text, lhs);
+                appendText(text, rhs);
+                return text;
+            }
+            return toNumber(lhs) + toNumber(rhs);
+        }
+        if (expr.op >= BinaryOp::Equal)
+            return evalBool(expr, frame);
+        return evalNumber(expr, frame);
+    }
+    }
+    return CatValue();
+}
+
+// --- Evaluate in numeric context (num declarations, arithmetic) ---
+// Same result as toNumber(evaluate(expr)), but numeric subtrees are computed on
+// doubles directly: no CatValue is built and nothing goes through text.
+double evalNumber(const Expr &expr, Frame &frame)
+{
+    switch (expr.kind)
+    {
+    case ExprKind::Number:
+        return expr.number;
+    case ExprKind::Bool:
+        return expr.boolean ? 1.0 : 0.0;
+    case ExprKind::Variable:
+    {
+        if (expr.slot < 0)
+            return 0.0;
+        const CatValue &value = frameFor(expr.scope, frame)[expr.slot];
+        return value.isNumber() ? value.asNumber() : toNumber(value);
+    }
+    case ExprKind::Negate:
+        return -evalNumber(*expr.operands[0], frame);
+    case ExprKind::Not:
+    case ExprKind::And:
+    case ExprKind::Or:
+        return evalBool(expr, frame) ? 1.0 : 0.0;
+
+    case ExprKind::Binary:
+    {
+        if (expr.op >= BinaryOp::Equal)
+            return evalBool(expr, frame) ? 1.0 : 0.0;
+        if (expr.op == BinaryOp::Add && !expr.numeric)
+            break;
+        // left operand first: a call on either side may print or change a variable
+        double l = evalNumber(*expr.operands[0], frame);
+        double r = evalNumber(*expr.operands[1], frame);
+        switch (expr.op)
+        {
+        case BinaryOp::Add:
+            return l + r;
+        case BinaryOp::Sub:
+            return l - r;
+        case BinaryOp::Mul:
+            return l * r;
+        default:
+            return l / r;
+        }
+    }
+    default:
+        break;
+    }
+    return toNumber(evaluate(expr, frame));
+}
+
+// --- Evaluate as a condition (if, &&, ||, !) ---
+// && and || stop as soon as the result is known; comparisons with a numeric
+// side compare doubles without building CatValues.
+bool evalBool(const Expr &expr, Frame &frame)
+{
+    switch (expr.kind)
+    {
+    case ExprKind::Bool:
+        return expr.boolean;
+    case ExprKind::Not:
+        return !evalBool(*expr.operands[0], frame);
+    case ExprKind::And:
+        return evalBool(*expr.operands[0], frame) && evalBool(*expr.operands[1], frame);
+    case ExprKind::Or:
+        return evalBool(*expr.operands[0], frame) || evalBool(*expr.operands[1], frame);
+    case ExprKind::Variable:
+        return expr.slot >= 0 && toBool(frameFor(expr.scope, frame)[expr.slot]);
+
+    case ExprKind::Binary:
+    {
+        if (expr.op < BinaryOp::Equal)
+            break;
+        const Expr &lhs = *expr.operands[0];
+        const Expr &rhs = *expr.operands[1];
+        // left operand first (function arguments would leave the order to the compiler)
+        if (lhs.numeric || rhs.numeric)
+        {
+            double l = evalNumber(lhs, frame);
+            return compareNumbers(expr.op, l, evalNumber(rhs, frame));
+        }
+        CatValue l = evaluate(lhs, frame);
+        return compareValues(expr.op, l, evaluate(rhs, frame));
+    }
+    default:
+        break;
+    }
+    return toBool(evaluate(expr, frame));
+}
+
+// --- Append one purr part ---
+// Literal chunks are copied as-is and variables are read in place. A variable
+// that has not been assigned yet prints as its name, like the old purr fallback.
+inline void renderPart(const Expr &part, Frame &frame, std::string &out)
+{
+    switch (part.kind)
+    {
+    case ExprKind::String:
+        out += part.text;
+        return;
+    case ExprKind::Variable:
+    {
+        if (part.slot < 0)
+            return;
+        const CatValue &value = frameFor(part.scope, frame)[part.slot];
+        if (value.isNil())
+            out += atomName(part.name);
+        else
+            appendText(out, value);
+        return;
+    }
+    default:
+        appendText(out, evaluate(part, frame));
+        return;
+    }
+}
+
+// --- Full text of a purr statement (a template built by the resolver) ---
+inline void renderPurr(const Expr &value, Frame &frame, std::string &out)
+{
+    if (value.kind != ExprKind::Concat)
+    {
+        renderPart(value, frame, out);
+        return;
+    }
+    for (const ExprPtr &part : value.operands)
+        renderPart(*part, frame, out);
+}
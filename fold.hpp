@@ -0,0 +1,295 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.hpp"
+#include "expressions.hpp"
+#include "resolver.hpp"
+
+// --- Constant folding and dead-branch elimination (-O1) ---
+// Runs over a resolved program, before either engine sees it:
+//   - an operator whose operands are all literals becomes the literal it
+//     evaluates to (so 60 * 60 * 24 is computed once, here, and "a" + "b" is one string);
+//   - a global declared exactly once, by a top-level statement that is not inside
+//     an if or loop, with a constant value, is replaced by that value wherever it
+//     is read after the declaration (top-level statements that follow it and the
+//     bodies of functions defined after it, unless those functions are saved by
+//     --snapshot-out: a later script run on the snapshot may declare the global again);
+//   - an if whose condition folds to a literal is replaced by the arm it takes,
+//     unless the dropped arm declares a variable (slots were handed out for it).
+// Folded values come from the tree walker's own evaluate(), so they are exactly
+// what the script would have computed at run time. --dump-folds lists every change.
+
+int optimizationLevel = 1; // -O0 / -O1
+bool dumpFolds = false;    // --dump-folds
+
+// --- Source-like rendering of an expression, for the fold dump ---
+inline std::string describeExpr(const Expr &expr)
+{
+    static const char *ops[] = {"+", "-", "*", "/", "==", "!=", "<", ">", "<=", ">="};
+    switch (expr.kind)
+    {
+    case ExprKind::Number:
+        return formatNumber(expr.number);
+    case ExprKind::String:
+    {
+        if (expr.text == "\n")
+            return "endl";
+        std::string out = "\"";
+        for (char c : expr.text)
+            out += c == '\n' ? std::string("\\n") : std::string(1, c);
+        return out + "\"";
+    }
+    case ExprKind::Bool:
+        return expr.boolean ? "true" : "false";
+    case ExprKind::Variable:
+        return atomName(expr.name);
+    case ExprKind::Call:
+    {
+        std::string out = atomName(expr.name) + "(";
+        for (size_t i = 0; i < expr.operands.size(); ++i)
+            out += (i ? ", " : "") + describeExpr(*expr.operands[i]);
+        return out + ")";
+    }
+    case ExprKind::Binary:
+        return "(" + describeExpr(*expr.operands[0]) + " " + ops[(int)expr.op] + " " + describeExpr(*expr.operands[1]) + ")";
+    case ExprKind::Negate:
+        return "-" + describeExpr(*expr.operands[0]);
+    case ExprKind::Not:
+        return "!" + describeExpr(*expr.operands[0]);
+    case ExprKind::And:
+        return "(" + describeExpr(*expr.operands[0]) + " && " + describeExpr(*expr.operands[1]) + ")";
+    case ExprKind::Or:
+        return "(" + describeExpr(*expr.operands[0]) + " || " + describeExpr(*expr.operands[1]) + ")";
+    case ExprKind::Concat:
+    {
+        std::string out;
+        for (size_t i = 0; i < expr.operands.size(); ++i)
+            out += (i ? " + " : "") + describeExpr(*expr.operands[i]);
+        return out;
+    }
+    }
+    return std::string();
+}
+
+struct Folder
+{
+    std::unordered_map<int, int> globalDeclarations; // global slot -> declarations of it anywhere
+    std::unordered_map<int, CatValue> constants;     // global slot -> value, for code after its declaration
+    Frame noFrame;                                   // literal-only expressions read no variables
+    bool globalsInFunctions = true;                  // false: function bodies keep reading the globals
+    bool inFunction = false;
+    size_t folded = 0;
+    size_t branches = 0;
+
+    static bool isLiteral(const Expr &expr)
+    {
+        return expr.kind == ExprKind::Number || expr.kind == ExprKind::String || expr.kind == ExprKind::Bool;
+    }
+
+    static ExprPtr literalFor(const CatValue &value, int line)
+    {
+        auto expr = astArena.create<Expr>();
+        expr->line = line;
+        switch (value.type())
+        {
+        case CatValue::Tag::Num:
+            expr->kind = ExprKind::Number;
+            expr->number = value.asNumber();
+            expr->numeric = true;
+            break;
+        case CatValue::Tag::Bool:
+            expr->kind = ExprKind::Bool;
+            expr->boolean = value.asBool();
+            expr->numeric = true;
+            break;
+        case CatValue::Tag::Str:
+            expr->kind = ExprKind::String;
+            expr->text = astArena.copy(value.asString());
+            break;
+        default:
+            return nullptr;
+        }
+        return expr;
+    }
+
+    // folds expr in place; true if anything in it changed
+    bool foldExpr(ExprPtr &expr)
+    {
+        if (expr->kind == ExprKind::Variable)
+        {
+            if (inFunction && !globalsInFunctions)
+                return false;
+            auto it = expr->scope == SlotScope::Global ? constants.find(expr->slot) : constants.end();
+            if (it == constants.end())
+                return false;
+            if (ExprPtr literal = literalFor(it->second, expr->line))
+            {
+                expr = literal;
+                return true;
+            }
+            return false;
+        }
+
+        bool changed = false;
+        bool allLiteral = true;
+        for (ExprPtr &operand : expr->operands)
+        {
+            changed |= foldExpr(operand);
+            allLiteral &= isLiteral(*operand);
+        }
+        switch (expr->kind)
+        {
+        case ExprKind::Binary:
+        case ExprKind::Negate:
+        case ExprKind::Not:
+        case ExprKind::And:
+        case ExprKind::Or:
+        case ExprKind::Concat:
+            break;
+        default:
+            return changed;
+        }
+        if (!allLiteral)
+            return changed;
+        if (ExprPtr literal = literalFor(evaluate(*expr, noFrame), expr->line))
+        {
+            expr = literal;
+            return true;
+        }
+        return changed;
+    }
+
+    // folds a statement's value, logging the change for --dump-folds
+    void foldValue(ExprPtr &value, int line)
+    {
+        std::string before = dumpFolds ? describeExpr(*value) : std::string();
+        if (foldExpr(value))
+        {
+            ++folded;
+            if (dumpFolds)
+                std::cerr << "fold line " << line << ": " << before << " => " << describeExpr(*value) << std::endl;
+        }
+    }
+
+    void foldBlock(Block &block)
+    {
+        Block out(&astArena);
+        out.reserve(block.size());
+        for (StmtPtr stmt : block)
+            foldStatement(stmt, out);
+        block = std::move(out);
+    }
+
+    // folds stmt and appends what is left of it to out
+    void foldStatement(StmtPtr stmt, Block &out)
+    {
+        switch (stmt->kind)
+        {
+        case StmtKind::Purr:
+        {
+            std::string before = dumpFolds ? describeExpr(*stmt->value) : std::string();
+            bool changed = false;
+            if (stmt->value->kind == ExprKind::Concat)
+            {
+                for (ExprPtr &part : stmt->value->operands)
+                    changed |= foldExpr(part);
+            }
+            else
+                changed = foldExpr(stmt->value);
+            if (changed)
+            {
+                Resolver::compilePurrTemplate(stmt->value); // merge the new literals with their neighbours
+                ++folded;
+                if (dumpFolds)
+                    std::cerr << "fold line " << stmt->line << ": purr " << before << " => " << describeExpr(*stmt->value) << std::endl;
+            }
+            break;
+        }
+        case StmtKind::Declare:
+        case StmtKind::Call:
+        case StmtKind::Return:
+            if (stmt->value)
+                foldValue(stmt->value, stmt->line);
+            break;
+        case StmtKind::If:
+        {
+            foldValue(stmt->value, stmt->line);
+            foldBlock(stmt->body);
+            foldBlock(stmt->elseBody);
+            if (isLiteral(*stmt->value))
+            {
+                bool taken = toBool(evaluate(*stmt->value, noFrame));
+                Block &kept = taken ? stmt->body : stmt->elseBody;
+                std::vector<const Stmt *> declared;
+                Resolver::collectDeclarationStmts(taken ? stmt->elseBody : stmt->body, declared);
+                if (declared.empty())
+                {
+                    ++branches;
+                    if (dumpFolds)
+                        std::cerr << "fold line " << stmt->line << ": if is always " << (taken ? "true" : "false")
+                                  << ", dropped the " << (taken ? "else" : "then") << " branch" << std::endl;
+                    out.insert(out.end(), kept.begin(), kept.end());
+                    return;
+                }
+            }
+            break;
+        }
+        case StmtKind::While:
+            if (stmt->init)
+            {
+                Block init(&astArena);
+                foldStatement(stmt->init, init);
+                stmt->init = init.empty() ? nullptr : init[0];
+            }
+            foldValue(stmt->value, stmt->line);
+            foldBlock(stmt->body);
+            if (stmt->step)
+            {
+                Block step(&astArena);
+                foldStatement(stmt->step, step);
+                stmt->step = step.empty() ? nullptr : step[0];
+            }
+            break;
+        case StmtKind::Function:
+            inFunction = true;
+            foldBlock(stmt->body);
+            inFunction = false;
+            break;
+        }
+        out.push_back(stmt);
+    }
+
+    void foldProgram(Program &program)
+    {
+        std::vector<const Stmt *> decls;
+        Resolver::collectDeclarationStmts(program, decls);
+        for (const Stmt *decl : decls)
+            ++globalDeclarations[decl->slot];
+
+        Program out(&astArena);
+        out.reserve(program.size());
+        for (StmtPtr stmt : program)
+        {
+            foldStatement(stmt, out);
+            // a global with one unconditional, constant declaration is a constant from here on
+            if (stmt->kind == StmtKind::Declare && globalDeclarations[stmt->slot] == 1 && isLiteral(*stmt->value))
+                constants[stmt->slot] = coerceTo(stmt->type, evaluate(*stmt->value, noFrame));
+        }
+        program = std::move(out);
+    }
+};
+
+// --- Optimize a resolved program at the current -O level ---
+// savesFunctions: the function bodies outlive this run (--snapshot-out)
+inline void optimizeProgram(Program &program, bool savesFunctions = false)
+{
+    if (optimizationLevel < 1)
+        return;
+    Folder folder;
+    folder.globalsInFunctions = !savesFunctions;
+    folder.foldProgram(program);
+    if (dumpFolds)
+        std::cerr << "folded " << folder.folded << " expressions, removed " << folder.branches << " dead branches" << std::endl;
+}
@@ -1,283 +1,325 @@
 #pragma once
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <variant>
-#include <regex>
-#include <sstream>
+#include <memory_resource>
+#include <string_view>
+#include <utility>
 #include <iostream>
-#include <stdexcept>
-// Forward declaration (replaceVars is defined in CatLang.cpp)
-std::string replaceVars(
-    const std::string &expr,
-    const std::unordered_map<std::string, std::string> &strVars,
-    const std::unordered_map<std::string, double> &numVars,
-    const std::unordered_map<std::string, bool> &boolVars);
+#include <sys/resource.h>
+#include "ast.hpp"
+#include "value.hpp"
 
-// --- Variant type for function return value ---
-using CatValue = std::variant<std::monostate, std::string, double, bool>;
-// --- Function argument representation ---
-struct FuncArg
-{
-    std::string type; // "num", "str", "bool"
-    std::string name;
-};
+// --- Flat frame of variable slots (indices come from the resolver) ---
+// Call frames are allocated from scratchArena; the global frame uses the heap.
+using Frame = std::pmr::vector<CatValue>;
+
+bool executeBlock(const Block &block, Frame &frame, CatValue *returnValue); // statements.hpp
 
 // --- CatLang function representation ---
 struct CatFunction
 {
-    std::string returnType;        // "num", "str", "bool", "void"
-    std::vector<FuncArg> args;     // Function arguments
-    std::vector<std::string> body; // Lines inside { }
+    const Stmt *def = nullptr; // Parsed definition, owned by the Program (null: not defined)
+    uint32_t version = 0;      // Moves on whenever the name gets a different definition
 };
 
-// --- Parse a function from script lines ---
-// lines: vector of all script lines
-// index: current line index (will be updated to closing '}')
-CatFunction parseFunction(const std::vector<std::string> &lines, size_t &index)
+// --- Global interpreter state ---
+std::vector<CatFunction> functions; // indexed by the function name's atom
+Frame globalFrame;
+
+inline const CatFunction *findFunction(Atom name)
 {
-    CatFunction func;
+    if ((size_t)name >= functions.size() || !functions[name].def)
+        return nullptr;
+    return &functions[name];
+}
 
-    std::regex funcHeader(R"(^\s*(num|str|bool|void)\s+([a-zA-Z_]\w*)\s*\((.*)\)\s*\{\s*$)");
-    std::smatch match;
+// --- Call-site caches ---
+// Each call expression remembers the definition it called last, stamped with
+// that function's version. Redefining a function moves only its own version on,
+// so only the call sites of that name look it up again.
+size_t callCacheHits = 0;
+size_t callCacheMisses = 0;
+bool reportCallStats = false; // --call-stats
 
-    if (!std::regex_match(lines[index], match, funcHeader))
+inline void defineFunction(Atom name, CatFunction func)
+{
+    if ((size_t)name >= functions.size())
+        functions.resize(symbols.size());
+    CatFunction &entry = functions[name];
+    if (entry.def != func.def)
     {
-        throw std::runtime_error("Invalid function definition: " + lines[index]);
+        entry.def = func.def;
+        ++entry.version;
     }
+}
 
-    func.returnType = match[1];
-    std::string funcName = match[2];
-    std::string argsList = match[3];
+// --- Call depth ---
+// Both engines stop a script cleanly with "Stack overflow" once more than
+// maxCallDepth calls are nested (--max-depth). The VM keeps its frames on the
+// heap, so its default allows millions of calls. The tree walker recurses on
+// the native stack: its default fits an 8 MB stack, and it also stops before
+// that stack runs out, whatever the limit says.
+const size_t treeMaxDepth = 5000;
+const size_t vmMaxDepth = 5000000;
+size_t maxCallDepth = treeMaxDepth;
+size_t callDepth = 0;             // tree walker calls in progress
+bool runAborted = false;          // a fatal runtime error stopped the script
+const char *nativeStackTop = nullptr;
+size_t nativeStackBudget = 0;
 
-    // Parse arguments
-    std::stringstream ss(argsList);
-    std::string arg;
-    while (std::getline(ss, arg, ','))
-    {
-        std::stringstream argStream(arg);
-        std::string type, name;
-        argStream >> type >> name;
-        if (!type.empty() && !name.empty())
-        {
-            func.args.push_back({type, name});
-        }
-    }
-
-    // Parse body until closing '}'
-    index++; // move to first line of body
-    while (index < lines.size() && lines[index].find('}') == std::string::npos)
-    {
-        func.body.push_back(lines[index]);
-        index++;
-    }
+// records where the native stack starts (call first thing in main) and how far it
+// may grow; not inlined, so its own frame lies just below main's
+__attribute__((noinline)) inline void initNativeStack()
+{
+    const size_t margin = 256 * 1024; // room for the deepest expression of one call
+    const size_t ceiling = (size_t)1 << 30;
+    struct rlimit limit;
+    size_t size = 8 * 1024 * 1024;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0)
+        size = limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > ceiling ? ceiling : (size_t)limit.rlim_cur;
+    nativeStackTop = (const char *)__builtin_frame_address(0);
+    nativeStackBudget = size > 2 * margin ? size - margin : size / 2;
+}
 
-    if (index >= lines.size())
-    {
-        throw std::runtime_error("Function missing closing }");
-    }
+// bytes of native stack in use below the top; a frame above it (main's own
+// locals) counts as none
+inline size_t nativeStackUsed(const char *here)
+{
+    return (uintptr_t)here < (uintptr_t)nativeStackTop ? (size_t)(nativeStackTop - here) : 0;
+}
 
-    // index now points to closing '}'
-    return func;
+inline std::string stackOverflowMessage(size_t depth)
+{
+    return "Stack overflow: more than " + std::to_string(depth) + " nested calls";
 }
 
-// --- Execute a function ---
-// strVars, numVars, boolVars: global variable maps
-CatValue executeFunction(
-    const CatFunction &func,
-    const std::vector<CatValue> &args,
-    std::unordered_map<std::string, std::string> &strVars,
-    std::unordered_map<std::string, double> &numVars,
-    std::unordered_map<std::string, bool> &boolVars)
+// a tree walker call is about to nest one level deeper
+inline void enterCall()
 {
-    // Create local scope copies
-    auto localStrVars = strVars;
-    auto localNumVars = numVars;
-    auto localBoolVars = boolVars;
+    char here;
+    if (++callDepth > maxCallDepth)
+        throw std::runtime_error(stackOverflowMessage(maxCallDepth));
+    if (nativeStackTop && nativeStackUsed(&here) > nativeStackBudget)
+        throw std::runtime_error(stackOverflowMessage(callDepth - 1) + " (the native stack is full; --engine=vm recurses deeper)");
+}
 
-    // Assign arguments to local scope
-    for (size_t i = 0; i < func.args.size() && i < args.size(); ++i)
-    {
-        const auto &[type, name] = func.args[i];
-        const CatValue &val = args[i];
+inline void leaveCall()
+{
+    --callDepth;
+}
 
-        if (type == "str" && std::holds_alternative<std::string>(val))
-            localStrVars[name] = std::get<std::string>(val);
-        else if (type == "num" && std::holds_alternative<double>(val))
-            localNumVars[name] = std::get<double>(val);
-        else if (type == "bool" && std::holds_alternative<bool>(val))
-            localBoolVars[name] = std::get<bool>(val);
-    }
+// --- Pending tail call ---
+// `return f(...)` in a function evaluates the arguments and leaves the call here
+// instead of making it; executeFunction then runs f in place of the returning
+// function, so a chain of tail calls takes one native frame.
+struct TailCall
+{
+    const Stmt *def = nullptr;
+    std::vector<CatValue> args;
+};
+TailCall pendingTailCall;
 
-    CatValue returnValue = std::monostate{};
+// --- Native code (jit.hpp) ---
+// Native code that has to fail (a stack overflow in a call it makes) cannot
+// throw through its own frames: the error waits in jitFault and is rethrown
+// once control is back in C++ frames. jitFaulted mirrors it as a plain byte that
+// native code tests after every call it makes, to return straight away.
+using JitEntry = double (*)(const double *args);
+JitEntry jitEntryFor(const Stmt *def);
+std::exception_ptr jitFault;
+bool jitFaulted = false;
 
-    // Execute function body line by line
-    for (std::string line : func.body)
+inline void rethrowJitFault()
+{
+    if (jitFault)
     {
-        // Trim whitespace
-        line.erase(0, line.find_first_not_of(" \t"));
-        line.erase(line.find_last_not_of(" \t") + 1);
-
-        if (line.empty())
-            continue;
+        std::exception_ptr fault = jitFault;
+        jitFault = nullptr;
+        jitFaulted = false;
+        std::rethrow_exception(fault);
+    }
+}
 
-        // --- Handle return ---
-        if (line.rfind("return ", 0) == 0)
+// --- Value conversions ---
+inline double toNumber(const CatValue &value)
+{
+    switch (value.type())
+    {
+    case CatValue::Tag::Num:
+        return value.asNumber();
+    case CatValue::Tag::Bool:
+        return value.asBool() ? 1.0 : 0.0;
+    case CatValue::Tag::Str:
+        // string in numeric context -> try parse number, else 0
+        try
         {
-            std::string retExpr = line.substr(7);
-            if (func.returnType == "str")
-            {
-                if (localStrVars.count(retExpr))
-                    returnValue = localStrVars[retExpr];
-                else if (retExpr.front() == '"' && retExpr.back() == '"')
-                    returnValue = retExpr.substr(1, retExpr.size() - 2);
-            }
-            else if (func.returnType == "num")
-            {
-                if (localNumVars.count(retExpr))
-                    returnValue = localNumVars[retExpr];
-                else
-                    try
-                    {
-                        returnValue = stod(retExpr);
-                    }
-                    catch (...)
-                    {
-                    }
-            }
-            else if (func.returnType == "bool")
-            {
-                if (localBoolVars.count(retExpr))
-                    returnValue = localBoolVars[retExpr];
-                else if (retExpr == "true" || retExpr == "false")
-                    returnValue = (retExpr == "true");
-            }
-            break;
+            return std::stod(value.asString());
         }
-
-        // --- Handle purr output inside functions ---
-        std::smatch match;
-        std::regex purrRegex(R"(^\s*purr\s*~>\s*(.+);\s*$)");
-        if (std::regex_match(line, match, purrRegex))
+        catch (...)
         {
-            std::string expr = match[1];
-            std::string replaced = replaceVars(expr, localStrVars, localNumVars, localBoolVars);
+        }
+        return 0.0;
+    default:
+        return 0.0;
+    }
+}
 
-            std::regex concatRegex(R"(\s*\+\s*)");
-            std::sregex_token_iterator iter(replaced.begin(), replaced.end(), concatRegex, -1);
-            std::sregex_token_iterator end;
-            std::string output;
+inline std::string toText(const CatValue &value)
+{
+    switch (value.type())
+    {
+    case CatValue::Tag::Str:
+        return value.asString();
+    case CatValue::Tag::Num:
+        return formatNumber(value.asNumber());
+    case CatValue::Tag::Bool:
+        return value.asBool() ? "true" : "false";
+    default:
+        return std::string();
+    }
+}
 
-            for (; iter != end; ++iter)
-            {
-                std::string part = iter->str();
-                if (part == "endl")
-                {
-                    std::cout << output << std::endl;
-                    output.clear();
-                }
-                else if (part.size() >= 2 && part.front() == '"' && part.back() == '"')
-                {
-                    part = part.substr(1, part.size() - 2);
-                    output += part;
-                }
-                else
-                {
-                    output += part;
-                }
-            }
-            if (!output.empty())
-                std::cout << output;
-            continue;
-        }
+// --- Append the text of a value without building a temporary string ---
+inline void appendText(std::string &out, const CatValue &value)
+{
+    switch (value.type())
+    {
+    case CatValue::Tag::Str:
+        out += value.asString();
+        break;
+    case CatValue::Tag::Num:
+        appendNumber(out, value.asNumber());
+        break;
+    case CatValue::Tag::Bool:
+        out += value.asBool() ? "true" : "false";
+        break;
+    default:
+        break;
+    }
+}
 
-        // Could add num/str/bool handling inside functions later
+inline bool toBool(const CatValue &value)
+{
+    switch (value.type())
+    {
+    case CatValue::Tag::Bool:
+        return value.asBool();
+    case CatValue::Tag::Num:
+        return value.asNumber() != 0.0;
+    case CatValue::Tag::Str:
+        return !value.asString().empty();
+    default:
+        return false;
     }
+}
 
-    return returnValue;
+// --- Convert a value to a declared type ("num", "str", "bool") ---
+// A value that already has the type is passed through, so a str keeps sharing its text.
+inline CatValue coerceTo(std::string_view type, CatValue value)
+{
+    if (type == "num")
+        return value.isNumber() ? value : CatValue(toNumber(value));
+    if (type == "str")
+        return value.isString() ? value : CatValue(toText(value));
+    if (type == "bool")
+        return value.isBool() ? value : CatValue(toBool(value));
+    return CatValue();
 }
 
-std::unordered_map<std::string, CatFunction> functions;
-inline std::vector<CatValue> parseFunctionArgs(
-    const std::string &argList,
-    const std::unordered_map<std::string, std::string> &strVars,
-    const std::unordered_map<std::string, double> &numVars,
-    const std::unordered_map<std::string, bool> &boolVars)
+CatValue runPendingTailCall();
+
+// --- Run a function's native code: arguments arrive as doubles, like num parameters ---
+inline CatValue runJitted(JitEntry entry, const Stmt &def, CatValue *argv, size_t argc)
 {
-    std::vector<CatValue> argValues;
-    std::stringstream ss(argList);
-    std::string arg;
+    // the doubles live in scratchArena, like an interpreted frame
+    size_t count = def.params.size();
+    double *args = (double *)scratchArena.allocate(count * sizeof(double), alignof(double));
+    for (size_t i = 0; i < count; ++i)
+        args[i] = i < argc ? toNumber(argv[i]) : 0.0;
+    double result = entry(args);
+    rethrowJitFault();
+    return result;
+}
 
-    while (std::getline(ss, arg, ','))
+// --- Execute a function ---
+// The callee gets a frame of its own parameters and locals; other names are
+// read straight from globalFrame, so a call never copies global state.
+// Arguments are moved into the frame; str arguments share their text with the caller.
+// The frame lives in scratchArena; the caller rewinds it once the call returns.
+// A tail call to a function with the same return type (or any tail call from a
+// void function) reuses this native frame: the old frame is dropped and the
+// callee's built in its place. A function compiled by --jit runs as native code.
+CatValue executeFunction(const CatFunction &func, std::pmr::vector<CatValue> &args)
+{
+    const Stmt *def = func.def;
+    std::string_view resultType = def->type; // the type the caller asked for
+    CatValue *argv = args.data();
+    size_t argc = args.size();
+    std::vector<CatValue> tailArgs;
+    Arena::Mark mark = scratchArena.mark();
+    CatValue returnValue;
+    for (;;)
     {
-        // Trim whitespace
-        arg.erase(0, arg.find_first_not_of(" \t"));
-        arg.erase(arg.find_last_not_of(" \t") + 1);
+        if (JitEntry entry = jitEntryFor(def))
+            returnValue = runJitted(entry, *def, argv, argc);
+        else
+        {
+            Frame frame(def->frameSize, &scratchArena);
 
-        if (arg.empty())
-            continue;
+            // Locals that shadow a global start out with the global's value
+            for (const auto &seed : def->globalSeeds)
+                frame[seed.first] = globalFrame[seed.second];
 
-        // Literal string
-        if (arg.front() == '"' && arg.back() == '"')
-        {
-            argValues.push_back(arg.substr(1, arg.size() - 2));
-        }
-        // Literal boolean
-        else if (arg == "true" || arg == "TRUE")
-        {
-            argValues.push_back(true);
-        }
-        else if (arg == "false" || arg == "FALSE")
-        {
-            argValues.push_back(false);
+            // Assign arguments to their slots
+            for (size_t i = 0; i < def->params.size(); ++i)
+                frame[def->params[i].slot] = coerceTo(def->params[i].type, i < argc ? std::move(argv[i]) : CatValue());
+
+            returnValue = CatValue();
+            executeBlock(def->body, frame, &returnValue);
         }
-        // Numeric literal
-        else
+        scratchArena.rewind(mark);
+
+        const Stmt *callee = pendingTailCall.def;
+        if (!callee)
+            break;
+        if (callee->type != def->type && def->type != "void")
         {
-            try
-            {
-                argValues.push_back(std::stod(arg));
-            }
-            catch (...)
-            {
-                // Check if it's a variable
-                if (strVars.count(arg))
-                    argValues.push_back(strVars.at(arg));
-                else if (numVars.count(arg))
-                    argValues.push_back(numVars.at(arg));
-                else if (boolVars.count(arg))
-                    argValues.push_back(boolVars.at(arg));
-                else
-                    argValues.push_back(std::monostate{}); // undefined
-            }
+            // the result still needs this function's conversion: an ordinary call
+            returnValue = runPendingTailCall();
+            break;
         }
+        pendingTailCall.def = nullptr;
+        tailArgs.swap(pendingTailCall.args);
+        def = callee;
+        argv = tailArgs.data();
+        argc = tailArgs.size();
     }
 
-    return argValues;
+    // Coerce the result to the declared return type (and the caller's, after tail calls)
+    returnValue = coerceTo(def->type, std::move(returnValue));
+    return def->type == resultType ? returnValue : coerceTo(resultType, std::move(returnValue));
 }
-double evaluateNumericExpression(const std::string &expr, const std::unordered_map<std::string, double> &numVars)
+
+// --- Make the pending tail call as an ordinary, nested call; returns its result ---
+CatValue runPendingTailCall()
 {
-    std::string replaced = expr;
-    // Replace variable names with their values
-    for (const auto &[var, val] : numVars)
-        replaced = std::regex_replace(replaced, std::regex("\\b" + var + "\\b"), std::to_string(val));
+    const Stmt *callee = pendingTailCall.def;
+    pendingTailCall.def = nullptr;
+    std::vector<CatValue> args;
+    args.swap(pendingTailCall.args);
 
-    // Use std::stringstream to parse simple expressions (very basic, left-to-right, no operator precedence)
-    std::stringstream ss(replaced);
-    double result = 0;
-    double num;
-    char op = '+';
-    while (ss >> num)
+    Arena::Mark mark = scratchArena.mark();
+    CatValue result;
     {
-        if (op == '+')
-            result += num;
-        else if (op == '-')
-            result -= num;
-        else if (op == '*')
-            result *= num;
-        else if (op == '/')
-            result /= num;
-        ss >> op; // read next operator
+        std::pmr::vector<CatValue> callArgs(std::make_move_iterator(args.begin()), std::make_move_iterator(args.end()),
+                                            &scratchArena);
+        enterCall();
+        result = executeFunction(CatFunction{callee}, callArgs);
+        leaveCall();
     }
+    scratchArena.rewind(mark);
     return result;
 }
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// --- Interned identifiers ---
+// The parser maps every identifier to a small integer atom, so later passes
+// compare and look up names as integers and each spelling is stored once.
+using Atom = int32_t;
+const Atom NoAtom = -1;
+
+struct SymbolTable
+{
+    std::deque<std::string> names;                    // atom -> spelling (deque keeps keys stable)
+    std::unordered_map<std::string_view, Atom> atoms; // spelling -> atom
+
+    Atom intern(std::string_view name)
+    {
+        auto it = atoms.find(name);
+        if (it != atoms.end())
+            return it->second;
+        names.emplace_back(name);
+        Atom atom = (Atom)names.size() - 1;
+        atoms.emplace(names.back(), atom);
+        return atom;
+    }
+
+    const std::string &name(Atom atom) const
+    {
+        return names[atom];
+    }
+
+    size_t size() const
+    {
+        return names.size();
+    }
+};
+
+SymbolTable symbols;
+
+inline Atom intern(std::string_view name)
+{
+    return symbols.intern(name);
+}
+
+inline const std::string &atomName(Atom atom)
+{
+    return symbols.name(atom);
+}
@@ -0,0 +1,670 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "expressions.hpp"
+#include "function.hpp"
+#include "memo.hpp"
+#include "output.hpp"
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define CATLANG_JIT 1
+#endif
+
+// --- Native code for numeric functions (--jit, tree engine, Linux x86-64) ---
+// A function qualifies when it returns num, takes only num parameters, declares
+// only num locals, reads no globals and is built from num literals, arithmetic,
+// comparisons, && || !, if, while/for, return and calls to functions that
+// never return str. Its body is translated statement by statement into SSE2
+// code: every parameter, local and temporary is a double in the native frame.
+// Anything else is left to the tree walker, and so is a function until it has
+// been called jitThreshold times.
+//
+// Calls from native code go through jitCall (call-site cache, memo cache, depth
+// limit), except that a `return` of a call to the function itself jumps back to
+// its start while the call site's cache still points at it. Other tail calls are
+// handed to executeFunction as a pending tail call, as in the tree walker.
+
+unsigned jitThreshold = 0; // calls before a function is compiled; 0 = --jit=off
+size_t jitCompiled = 0;
+size_t jitRejectedCount = 0;
+
+// --- Calls made by native code ---
+// Plain functions with the SysV calling convention: (rdi, rsi, rdx) -> xmm0.
+inline double jitCall(const Expr *call, const double *args, uint64_t count)
+{
+    if (jitFault)
+        return 0.0;
+    try
+    {
+        const Stmt *def = resolveCall(*call);
+        if (!def)
+        {
+            errorStream() << "Undefined function: " << atomName(call->name) << std::endl;
+            return 0.0;
+        }
+        if (def->jitEntry && count >= def->params.size() && !memoizes(def->pure, def->declaredPure))
+        {
+            // native to native: the arguments are already doubles
+            enterCall();
+            double result = def->jitEntry(args);
+            leaveCall();
+            rethrowJitFault();
+            if (pendingTailCall.def)
+                result = toNumber(runPendingTailCall());
+            return result;
+        }
+        Arena::Mark mark = scratchArena.mark();
+        CatValue result;
+        {
+            std::pmr::vector<CatValue> values(&scratchArena);
+            values.reserve(count);
+            for (uint64_t i = 0; i < count; ++i)
+                values.push_back(args[i]);
+            result = invokeFunction(def, values);
+        }
+        scratchArena.rewind(mark);
+        return toNumber(result);
+    }
+    catch (...)
+    {
+        jitFault = std::current_exception();
+        jitFaulted = true;
+        return 0.0;
+    }
+}
+
+// `return f(...)`: leaves the call pending for executeFunction (see prepareTailCall)
+inline double jitTailCall(const Expr *call, const double *args, uint64_t count)
+{
+    if (jitFault)
+        return 0.0;
+    const Stmt *def = resolveCall(*call);
+    if (!def)
+    {
+        errorStream() << "Undefined function: " << atomName(call->name) << std::endl;
+        return 0.0;
+    }
+    std::vector<CatValue> values(args, args + count);
+    pendingTailCall.def = def;
+    pendingTailCall.args.swap(values);
+    return 0.0;
+}
+
+#ifdef CATLANG_JIT
+
+// --- Template code generator ---
+// Expressions leave their value in xmm0; xmm1 holds a right-hand operand. Frame
+// slot k is the double at [rbp - 8 * (k + 1)]: locals first, then temporaries.
+struct JitCompiler
+{
+    const Stmt &def;
+    std::vector<uint8_t> code;
+    int slots;         // frame slots in use
+    int maxSlots;
+    size_t frameFixup = 0;     // where the frame size is patched in
+    size_t bodyStart = 0;      // first instruction after the prologue
+    std::vector<std::vector<size_t>> labelUses; // rel32 fields jumping to each label
+    std::vector<long> labelAt;
+    int epilogue = -1;
+
+    explicit JitCompiler(const Stmt &function) : def(function), slots(function.frameSize), maxSlots(function.frameSize) {}
+
+    // --- Eligibility ---
+    bool exprOk(const Expr &expr) const
+    {
+        if (!expr.numeric)
+            return false;
+        switch (expr.kind)
+        {
+        case ExprKind::Number:
+        case ExprKind::Bool:
+            return true;
+        case ExprKind::Variable:
+            return expr.slot >= 0 && expr.scope == SlotScope::Local;
+        case ExprKind::Binary:
+        case ExprKind::Negate:
+        case ExprKind::Not:
+        case ExprKind::And:
+        case ExprKind::Or:
+        case ExprKind::Call:
+            for (const ExprPtr &operand : expr.operands)
+                if (!exprOk(*operand))
+                    return false;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool blockOk(const Block &block) const
+    {
+        for (const StmtPtr &stmt : block)
+            if (!stmtOk(*stmt))
+                return false;
+        return true;
+    }
+
+    bool stmtOk(const Stmt &stmt) const
+    {
+        switch (stmt.kind)
+        {
+        case StmtKind::Declare:
+            return stmt.type == "num" && stmt.scope == SlotScope::Local && exprOk(*stmt.value);
+        case StmtKind::Call:
+            return exprOk(*stmt.value);
+        case StmtKind::Return:
+            return !stmt.value || exprOk(*stmt.value);
+        case StmtKind::If:
+            return exprOk(*stmt.value) && blockOk(stmt.body) && blockOk(stmt.elseBody);
+        case StmtKind::While:
+            return (!stmt.init || stmtOk(*stmt.init)) && exprOk(*stmt.value) && blockOk(stmt.body) &&
+                   (!stmt.step || stmtOk(*stmt.step));
+        default:
+            return false;
+        }
+    }
+
+    bool eligible() const
+    {
+        if (def.type != "num" || !def.globalSeeds.empty())
+            return false;
+        for (const FuncArg &param : def.params)
+            if (param.type != "num")
+                return false;
+        return blockOk(def.body);
+    }
+
+    // --- Encoding ---
+    void bytes(std::initializer_list<uint8_t> list) { code.insert(code.end(), list); }
+
+    void u32(uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+            code.push_back((uint8_t)(value >> (8 * i)));
+    }
+
+    void u64(uint64_t value)
+    {
+        for (int i = 0; i < 8; ++i)
+            code.push_back((uint8_t)(value >> (8 * i)));
+    }
+
+    static int32_t slotOffset(int slot) { return -8 * (slot + 1); }
+
+    // movsd xmm, [rbp + disp32]
+    void load(int xmm, int slot)
+    {
+        bytes({0xF2, 0x0F, 0x10, (uint8_t)(0x85 | (xmm << 3))});
+        u32((uint32_t)slotOffset(slot));
+    }
+
+    // movsd [rbp + disp32], xmm
+    void store(int slot, int xmm)
+    {
+        bytes({0xF2, 0x0F, 0x11, (uint8_t)(0x85 | (xmm << 3))});
+        u32((uint32_t)slotOffset(slot));
+    }
+
+    void loadConstant(double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, 8);
+        if (bits == 0)
+        {
+            bytes({0x66, 0x0F, 0x57, 0xC0}); // xorpd xmm0, xmm0
+            return;
+        }
+        bytes({0x48, 0xB8}); // mov rax, imm64
+        u64(bits);
+        bytes({0x66, 0x48, 0x0F, 0x6E, 0xC0}); // movq xmm0, rax
+    }
+
+    int newLabel()
+    {
+        labelAt.push_back(-1);
+        labelUses.emplace_back();
+        return (int)labelAt.size() - 1;
+    }
+
+    void bind(int label) { labelAt[label] = (long)code.size(); }
+
+    void jump(int label)
+    {
+        bytes({0xE9});
+        labelUses[label].push_back(code.size());
+        u32(0);
+    }
+
+    // jcc rel32 with the given condition code (0x84 je, 0x85 jne, 0x8A jp, ...)
+    void jumpIf(uint8_t condition, int label)
+    {
+        bytes({0x0F, condition});
+        labelUses[label].push_back(code.size());
+        u32(0);
+    }
+
+    int allocTemp()
+    {
+        int slot = slots++;
+        maxSlots = slots > maxSlots ? slots : maxSlots;
+        return slot;
+    }
+
+    // calls helper(call, &slot[first], count) with count arguments stored downwards from
+    // first; a call that failed returns from this function too, up to the C++ frame
+    // that rethrows the fault (loops in the caller would otherwise keep running)
+    void callHelper(double (*helper)(const Expr *, const double *, uint64_t), const Expr &call, int first, int count)
+    {
+        bytes({0x48, 0xBF}); // mov rdi, imm64
+        u64((uint64_t)(uintptr_t)&call);
+        bytes({0x48, 0x8D, 0xB5}); // lea rsi, [rbp + disp32]
+        u32((uint32_t)slotOffset(first + count - 1));
+        bytes({0xBA}); // mov edx, imm32
+        u32((uint32_t)count);
+        bytes({0x48, 0xB8}); // mov rax, imm64
+        u64((uint64_t)(uintptr_t)helper);
+        bytes({0xFF, 0xD0}); // call rax
+        bytes({0x48, 0xB9}); // mov rcx, &jitFaulted
+        u64((uint64_t)(uintptr_t)&jitFaulted);
+        bytes({0x80, 0x39, 0x00}); // cmp byte [rcx], 0
+        jumpIf(0x85, epilogue);
+    }
+
+    // evaluates a call's arguments into consecutive slots (argument i at the lower
+    // address i, so they form an array); returns the first slot
+    int emitArguments(const Expr &call)
+    {
+        int count = (int)call.operands.size();
+        int first = slots;
+        for (int i = 0; i < count; ++i)
+            allocTemp();
+        for (int i = 0; i < count; ++i)
+        {
+            emitExpr(*call.operands[i]);
+            store(first + count - 1 - i, 0);
+        }
+        return first;
+    }
+
+    // --- Expressions: value in xmm0 ---
+    void emitExpr(const Expr &expr)
+    {
+        switch (expr.kind)
+        {
+        case ExprKind::Number:
+            loadConstant(expr.number);
+            return;
+        case ExprKind::Bool:
+            loadConstant(expr.boolean ? 1.0 : 0.0);
+            return;
+        case ExprKind::Variable:
+            load(0, expr.slot);
+            return;
+        case ExprKind::Negate:
+            emitExpr(*expr.operands[0]);
+            bytes({0x48, 0xB8}); // mov rax, sign bit
+            u64(0x8000000000000000ull);
+            bytes({0x66, 0x48, 0x0F, 0x6E, 0xC8}); // movq xmm1, rax
+            bytes({0x66, 0x0F, 0x57, 0xC1});       // xorpd xmm0, xmm1
+            return;
+        case ExprKind::Call:
+        {
+            int saved = slots;
+            int first = emitArguments(expr);
+            callHelper(jitCall, expr, first, (int)expr.operands.size());
+            slots = saved;
+            return;
+        }
+        case ExprKind::Binary:
+            if (expr.op < BinaryOp::Equal)
+            {
+                emitOperands(expr);
+                static const uint8_t ops[] = {0x58, 0x5C, 0x59, 0x5E}; // addsd subsd mulsd divsd
+                bytes({0xF2, 0x0F, ops[(int)expr.op], 0xC1});
+                return;
+            }
+            break;
+        default:
+            break;
+        }
+        // a condition used as a number: 1 or 0
+        int isFalse = newLabel(), done = newLabel();
+        emitCondition(expr, isFalse);
+        loadConstant(1.0);
+        jump(done);
+        bind(isFalse);
+        bytes({0x66, 0x0F, 0x57, 0xC0}); // xorpd xmm0, xmm0
+        bind(done);
+    }
+
+    // a literal or variable: loaded straight into any register, no temporary needed
+    static bool isLeaf(const Expr &expr)
+    {
+        return expr.kind == ExprKind::Number || expr.kind == ExprKind::Bool || expr.kind == ExprKind::Variable;
+    }
+
+    void loadLeaf(int xmm, const Expr &expr)
+    {
+        if (expr.kind == ExprKind::Variable)
+        {
+            load(xmm, expr.slot);
+            return;
+        }
+        double value = expr.kind == ExprKind::Number ? expr.number : expr.boolean ? 1.0 : 0.0;
+        uint64_t bits;
+        std::memcpy(&bits, &value, 8);
+        bytes({0x48, 0xB8}); // mov rax, imm64
+        u64(bits);
+        bytes({0x66, 0x48, 0x0F, 0x6E, (uint8_t)(0xC0 | (xmm << 3))}); // movq xmm, rax
+    }
+
+    // lhs in xmm0, rhs in xmm1
+    void emitOperands(const Expr &expr)
+    {
+        if (isLeaf(*expr.operands[1]))
+        {
+            emitExpr(*expr.operands[0]);
+            loadLeaf(1, *expr.operands[1]);
+            return;
+        }
+        if (isLeaf(*expr.operands[0]))
+        {
+            emitExpr(*expr.operands[1]);
+            bytes({0xF2, 0x0F, 0x10, 0xC8}); // movsd xmm1, xmm0
+            loadLeaf(0, *expr.operands[0]);
+            return;
+        }
+        emitExpr(*expr.operands[0]);
+        int temp = allocTemp();
+        store(temp, 0);
+        emitExpr(*expr.operands[1]);
+        bytes({0xF2, 0x0F, 0x10, 0xC8}); // movsd xmm1, xmm0
+        load(0, temp);
+        --slots;
+    }
+
+    // --- Conditions: jump to ifFalse unless expr holds ---
+    void emitCondition(const Expr &expr, int ifFalse)
+    {
+        switch (expr.kind)
+        {
+        case ExprKind::Bool:
+            if (!expr.boolean)
+                jump(ifFalse);
+            return;
+        case ExprKind::Not:
+        {
+            int skip = newLabel();
+            emitCondition(*expr.operands[0], skip);
+            jump(ifFalse);
+            bind(skip);
+            return;
+        }
+        case ExprKind::And:
+            emitCondition(*expr.operands[0], ifFalse);
+            emitCondition(*expr.operands[1], ifFalse);
+            return;
+        case ExprKind::Or:
+        {
+            int tryRight = newLabel(), done = newLabel();
+            emitCondition(*expr.operands[0], tryRight);
+            jump(done);
+            bind(tryRight);
+            emitCondition(*expr.operands[1], ifFalse);
+            bind(done);
+            return;
+        }
+        case ExprKind::Binary:
+            if (expr.op >= BinaryOp::Equal)
+            {
+                emitOperands(expr);
+                // unordered (NaN) sets ZF, PF and CF: every comparison but != is then false
+                switch (expr.op)
+                {
+                case BinaryOp::Equal:
+                    bytes({0x66, 0x0F, 0x2E, 0xC1}); // ucomisd xmm0, xmm1
+                    jumpIf(0x85, ifFalse);           // jne
+                    jumpIf(0x8A, ifFalse);           // jp
+                    return;
+                case BinaryOp::NotEqual:
+                {
+                    int holds = newLabel();
+                    bytes({0x66, 0x0F, 0x2E, 0xC1});
+                    jumpIf(0x8A, holds);   // jp
+                    jumpIf(0x84, ifFalse); // je
+                    bind(holds);
+                    return;
+                }
+                case BinaryOp::Less:
+                    bytes({0x66, 0x0F, 0x2E, 0xC8}); // ucomisd xmm1, xmm0
+                    jumpIf(0x86, ifFalse);           // jbe
+                    return;
+                case BinaryOp::Greater:
+                    bytes({0x66, 0x0F, 0x2E, 0xC1});
+                    jumpIf(0x86, ifFalse); // jbe
+                    return;
+                case BinaryOp::LessEqual:
+                    bytes({0x66, 0x0F, 0x2E, 0xC8});
+                    jumpIf(0x82, ifFalse); // jb
+                    return;
+                case BinaryOp::GreaterEqual:
+                    bytes({0x66, 0x0F, 0x2E, 0xC1});
+                    jumpIf(0x82, ifFalse); // jb
+                    return;
+                default:
+                    break;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+        // a number is true unless it is 0 (NaN counts as true)
+        emitExpr(expr);
+        int holds = newLabel();
+        bytes({0x66, 0x0F, 0x57, 0xC9}); // xorpd xmm1, xmm1
+        bytes({0x66, 0x0F, 0x2E, 0xC1}); // ucomisd xmm0, xmm1
+        jumpIf(0x8A, holds);
+        jumpIf(0x84, ifFalse);
+        bind(holds);
+    }
+
+    // --- Statements ---
+    void emitBlock(const Block &block)
+    {
+        for (const StmtPtr &stmt : block)
+            emitStatement(*stmt);
+    }
+
+    void emitStatement(const Stmt &stmt)
+    {
+        switch (stmt.kind)
+        {
+        case StmtKind::Declare:
+            emitExpr(*stmt.value);
+            store(stmt.slot, 0);
+            return;
+        case StmtKind::Call:
+            emitExpr(*stmt.value);
+            return;
+        case StmtKind::Return:
+            if (!stmt.value)
+                loadConstant(0.0);
+            else if (stmt.value->kind == ExprKind::Call)
+                emitTailCall(*stmt.value);
+            else
+                emitExpr(*stmt.value);
+            jump(epilogue);
+            return;
+        case StmtKind::If:
+        {
+            int elseLabel = newLabel(), done = newLabel();
+            emitCondition(*stmt.value, elseLabel);
+            emitBlock(stmt.body);
+            jump(done);
+            bind(elseLabel);
+            emitBlock(stmt.elseBody);
+            bind(done);
+            return;
+        }
+        case StmtKind::While:
+        {
+            int top = newLabel(), done = newLabel();
+            if (stmt.init)
+                emitStatement(*stmt.init);
+            bind(top);
+            emitCondition(*stmt.value, done);
+            emitBlock(stmt.body);
+            if (stmt.step)
+                emitStatement(*stmt.step);
+            jump(top);
+            bind(done);
+            return;
+        }
+        default:
+            return;
+        }
+    }
+
+    // `return f(...)`: a call back to this very definition restarts the body with
+    // the new arguments; any other call is left pending for executeFunction
+    void emitTailCall(const Expr &call)
+    {
+        int saved = slots;
+        int first = emitArguments(call);
+        int count = (int)call.operands.size();
+        if (call.name == def.name)
+        {
+            int other = newLabel();
+            bytes({0x48, 0xBF}); // mov rdi, &call
+            u64((uint64_t)(uintptr_t)&call);
+            bytes({0x48, 0xB8}); // mov rax, resolveCall (the reference argument is a pointer)
+            u64((uint64_t)(uintptr_t)&resolveCall);
+            bytes({0xFF, 0xD0}); // call rax
+            bytes({0x48, 0xB9}); // mov rcx, &def
+            u64((uint64_t)(uintptr_t)&def);
+            bytes({0x48, 0x39, 0xC8}); // cmp rax, rcx
+            jumpIf(0x85, other);
+
+            // a fresh frame: parameters from the arguments, every other local 0 (nil)
+            std::vector<bool> isParam(def.frameSize, false);
+            for (size_t i = 0; i < def.params.size(); ++i)
+            {
+                if (i < (size_t)count)
+                    load(0, first + count - 1 - (int)i);
+                else
+                    loadConstant(0.0);
+                store(def.params[i].slot, 0);
+                isParam[def.params[i].slot] = true;
+            }
+            bytes({0x66, 0x0F, 0x57, 0xC0}); // xorpd xmm0, xmm0
+            for (int slot = 0; slot < def.frameSize; ++slot)
+                if (!isParam[slot])
+                    store(slot, 0);
+            jump(restart);
+            bind(other);
+        }
+        callHelper(jitTailCall, call, first, count);
+        slots = saved;
+    }
+
+    int restart = -1;
+
+    // --- Whole function ---
+    bool compile()
+    {
+        if (!eligible())
+            return false;
+        epilogue = newLabel();
+        restart = newLabel();
+        bytes({0x55});             // push rbp
+        bytes({0x48, 0x89, 0xE5}); // mov rbp, rsp
+        bytes({0x48, 0x81, 0xEC}); // sub rsp, imm32
+        frameFixup = code.size();
+        u32(0);
+
+        // locals start out as 0, parameters come from args (rdi)
+        bytes({0x66, 0x0F, 0x57, 0xC0}); // xorpd xmm0, xmm0
+        for (int slot = 0; slot < def.frameSize; ++slot)
+            store(slot, 0);
+        for (size_t i = 0; i < def.params.size(); ++i)
+        {
+            bytes({0xF2, 0x0F, 0x10, 0x87}); // movsd xmm0, [rdi + disp32]
+            u32((uint32_t)(8 * i));
+            store(def.params[i].slot, 0);
+        }
+        bind(restart);
+
+        emitBlock(def.body);
+        bytes({0x66, 0x0F, 0x57, 0xC0}); // falling off the end returns 0 (nil as num)
+        bind(epilogue);
+        bytes({0xC9, 0xC3}); // leave; ret
+
+        uint32_t frame = (uint32_t)((8 * maxSlots + 15) & ~15);
+        std::memcpy(&code[frameFixup], &frame, 4);
+        for (size_t label = 0; label < labelAt.size(); ++label)
+        {
+            for (size_t at : labelUses[label])
+            {
+                int32_t rel = (int32_t)(labelAt[label] - (long)(at + 4));
+                std::memcpy(&code[at], &rel, 4);
+            }
+        }
+        return true;
+    }
+};
+
+// --- Copy code into executable memory (never written again, never freed) ---
+inline JitEntry installCode(const std::vector<uint8_t> &code)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (code.size() + page - 1) / page * page;
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return nullptr;
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, size);
+        return nullptr;
+    }
+    return (JitEntry)memory;
+}
+
+inline JitEntry compileNative(const Stmt &def)
+{
+    JitCompiler compiler(def);
+    return compiler.compile() ? installCode(compiler.code) : nullptr;
+}
+
+#else
+
+inline JitEntry compileNative(const Stmt &)
+{
+    return nullptr; // no code generator for this platform
+}
+
+#endif
+
+// --- Native code for a definition, compiling it once it is called often enough ---
+JitEntry jitEntryFor(const Stmt *def)
+{
+    if (def->jitEntry || jitThreshold == 0 || def->jitRejected)
+        return def->jitEntry;
+    if (++def->jitCalls < jitThreshold)
+        return nullptr;
+    def->jitEntry = compileNative(*def);
+    if (def->jitEntry)
+        ++jitCompiled;
+    else
+    {
+        def->jitRejected = true;
+        ++jitRejectedCount;
+    }
+    return def->jitEntry;
+}
@@ -0,0 +1,328 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cctype>
+
+// --- Token kinds produced by the lexer ---
+enum class TokenType
+{
+    // keywords
+    Purr,
+    Num,
+    Str,
+    Bool,
+    Void,
+    If,
+    Else,
+    While,
+    For,
+    Return,
+    Endl,
+    // literals and names
+    Identifier,
+    NumberLiteral,
+    StringLiteral,
+    BoolLiteral,
+    // operators and punctuation
+    Arrow, // ~>
+    LParen,
+    RParen,
+    LBrace,
+    RBrace,
+    Comma,
+    Semicolon,
+    Plus,
+    Minus,
+    Star,
+    Slash,
+    Equal,
+    NotEqual,
+    Less,
+    Greater,
+    LessEqual,
+    GreaterEqual,
+    AndAnd, // &&
+    OrOr,   // ||
+    Bang,   // !
+    Unknown,
+    End
+};
+
+// --- A single token ---
+// pos/length locate the token inside the source, line is 1-based,
+// text views the identifier/literal spelling inside the source (string literals
+// without quotes), so the source must outlive the tokens and anything built from them
+struct Token
+{
+    TokenType type;
+    size_t pos;
+    size_t length;
+    int line;
+    std::string_view text;
+};
+
+inline bool isIdentStart(char c)
+{
+    return std::isalpha((unsigned char)c) || c == '_';
+}
+
+inline bool isIdentChar(char c)
+{
+    return std::isalnum((unsigned char)c) || c == '_';
+}
+
+// true/false are accepted in any case, like the old icase bool regex
+inline bool isBoolWord(std::string_view word)
+{
+    if (word.size() != 4 && word.size() != 5)
+        return false;
+    char lower[5];
+    for (size_t i = 0; i < word.size(); ++i)
+        lower[i] = (char)std::tolower((unsigned char)word[i]);
+    std::string_view folded(lower, word.size());
+    return folded == "true" || folded == "false";
+}
+
+inline TokenType keywordType(std::string_view word)
+{
+    switch (word.size())
+    {
+    case 2:
+        if (word == "if")
+            return TokenType::If;
+        break;
+    case 3:
+        if (word == "num")
+            return TokenType::Num;
+        if (word == "str")
+            return TokenType::Str;
+        if (word == "for")
+            return TokenType::For;
+        break;
+    case 4:
+        if (word == "purr")
+            return TokenType::Purr;
+        if (word == "bool")
+            return TokenType::Bool;
+        if (word == "void")
+            return TokenType::Void;
+        if (word == "else")
+            return TokenType::Else;
+        if (word == "endl")
+            return TokenType::Endl;
+        break;
+    case 5:
+        if (word == "while")
+            return TokenType::While;
+        break;
+    case 6:
+        if (word == "return")
+            return TokenType::Return;
+        break;
+    }
+    if (isBoolWord(word))
+        return TokenType::BoolLiteral;
+    return TokenType::Identifier;
+}
+
+// --- Tokenize a whole script in a single left-to-right pass ---
+// Comments (// and /* */) are skipped here, so nothing downstream sees them.
+// firstLine numbers the lines of a piece of a longer script (see SourceStream).
+inline std::vector<Token> tokenize(std::string_view source, int firstLine = 1)
+{
+    std::vector<Token> tokens;
+    size_t i = 0;
+    int line = firstLine;
+    const size_t n = source.size();
+
+    auto push = [&](TokenType type, size_t start, size_t len, std::string_view text = std::string_view())
+    {
+        tokens.push_back({type, start, len, line, text});
+    };
+
+    while (i < n)
+    {
+        char c = source[i];
+        if (c == '\n')
+        {
+            ++line;
+            ++i;
+            continue;
+        }
+        if (std::isspace((unsigned char)c))
+        {
+            ++i;
+            continue;
+        }
+
+        char next = i + 1 < n ? source[i + 1] : '\0';
+
+        // comments
+        if (c == '/' && next == '/')
+        {
+            while (i < n && source[i] != '\n')
+                ++i;
+            continue;
+        }
+        if (c == '/' && next == '*')
+        {
+            i += 2;
+            while (i < n && !(source[i] == '*' && i + 1 < n && source[i + 1] == '/'))
+            {
+                if (source[i] == '\n')
+                    ++line;
+                ++i;
+            }
+            i = i < n ? i + 2 : n;
+            continue;
+        }
+
+        size_t start = i;
+        if (isIdentStart(c))
+        {
+            while (i < n && isIdentChar(source[i]))
+                ++i;
+            std::string_view word = source.substr(start, i - start);
+            push(keywordType(word), start, i - start, word);
+            continue;
+        }
+
+        if (std::isdigit((unsigned char)c) || (c == '.' && std::isdigit((unsigned char)next)))
+        {
+            bool dotSeen = false;
+            while (i < n && (std::isdigit((unsigned char)source[i]) || (source[i] == '.' && !dotSeen)))
+            {
+                if (source[i] == '.')
+                    dotSeen = true;
+                ++i;
+            }
+            // exponent (1e20, 2.5e-3), as numbers are printed; only when digits follow
+            if (i < n && (source[i] == 'e' || source[i] == 'E'))
+            {
+                size_t digits = i + 1;
+                if (digits < n && (source[digits] == '+' || source[digits] == '-'))
+                    ++digits;
+                if (digits < n && std::isdigit((unsigned char)source[digits]))
+                {
+                    i = digits;
+                    while (i < n && std::isdigit((unsigned char)source[i]))
+                        ++i;
+                }
+            }
+            push(TokenType::NumberLiteral, start, i - start, source.substr(start, i - start));
+            continue;
+        }
+
+        if (c == '"')
+        {
+            size_t close = i + 1;
+            while (close < n && source[close] != '"' && source[close] != '\n')
+                ++close;
+            if (close >= n || source[close] != '"')
+            {
+                // unterminated literal: keep the rest of the line as one unknown token
+                push(TokenType::Unknown, start, close - start, source.substr(start, close - start));
+                i = close;
+                continue;
+            }
+            push(TokenType::StringLiteral, start, close + 1 - start, source.substr(i + 1, close - i - 1));
+            i = close + 1;
+            continue;
+        }
+
+        switch (c)
+        {
+        case '~':
+            if (next == '>')
+            {
+                push(TokenType::Arrow, start, 2);
+                i += 2;
+                continue;
+            }
+            break;
+        case '=':
+            if (next == '=')
+            {
+                push(TokenType::Equal, start, 2);
+                i += 2;
+                continue;
+            }
+            break;
+        case '!':
+            push(next == '=' ? TokenType::NotEqual : TokenType::Bang, start, next == '=' ? 2 : 1);
+            i += next == '=' ? 2 : 1;
+            continue;
+        case '&':
+            if (next == '&')
+            {
+                push(TokenType::AndAnd, start, 2);
+                i += 2;
+                continue;
+            }
+            break;
+        case '|':
+            if (next == '|')
+            {
+                push(TokenType::OrOr, start, 2);
+                i += 2;
+                continue;
+            }
+            break;
+        case '<':
+            push(next == '=' ? TokenType::LessEqual : TokenType::Less, start, next == '=' ? 2 : 1);
+            i += next == '=' ? 2 : 1;
+            continue;
+        case '>':
+            push(next == '=' ? TokenType::GreaterEqual : TokenType::Greater, start, next == '=' ? 2 : 1);
+            i += next == '=' ? 2 : 1;
+            continue;
+        case '(':
+            push(TokenType::LParen, start, 1);
+            ++i;
+            continue;
+        case ')':
+            push(TokenType::RParen, start, 1);
+            ++i;
+            continue;
+        case '{':
+            push(TokenType::LBrace, start, 1);
+            ++i;
+            continue;
+        case '}':
+            push(TokenType::RBrace, start, 1);
+            ++i;
+            continue;
+        case ',':
+            push(TokenType::Comma, start, 1);
+            ++i;
+            continue;
+        case ';':
+            push(TokenType::Semicolon, start, 1);
+            ++i;
+            continue;
+        case '+':
+            push(TokenType::Plus, start, 1);
+            ++i;
+            continue;
+        case '-':
+            push(TokenType::Minus, start, 1);
+            ++i;
+            continue;
+        case '*':
+            push(TokenType::Star, start, 1);
+            ++i;
+            continue;
+        case '/':
+            push(TokenType::Slash, start, 1);
+            ++i;
+            continue;
+        }
+
+        push(TokenType::Unknown, start, 1, source.substr(start, 1));
+        ++i;
+    }
+
+    push(TokenType::End, n, 0);
+    return tokens;
+}
@@ -0,0 +1,195 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ast.hpp"
+#include "output.hpp"
+#include "value.hpp"
+
+// --- Memoization of pure functions ---
+// A function is pure when its result depends on nothing but its arguments: it
+// never purrs, reads no global (nor a local seeded from one) and calls only
+// pure functions that are defined exactly once, so no redefinition can change
+// what a call means. A pure function written with the `pure` modifier, or any
+// pure function under --memoize, has its results cached by argument values in
+// one bounded LRU cache shared by all functions.
+
+bool memoizeAll = false; // --memoize
+
+// --- Purity analysis over the function definitions of a whole program ---
+struct PurityAnalysis
+{
+    std::unordered_map<Atom, std::vector<Stmt *>> definitions;
+
+    bool exprIsPure(const Expr &expr) const
+    {
+        if (expr.kind == ExprKind::Variable && (expr.slot < 0 || expr.scope == SlotScope::Global))
+            return false;
+        if (expr.kind == ExprKind::Call)
+        {
+            auto it = definitions.find(expr.name);
+            if (it == definitions.end() || it->second.size() != 1 || !it->second[0]->pure)
+                return false;
+        }
+        for (const ExprPtr &operand : expr.operands)
+            if (!exprIsPure(*operand))
+                return false;
+        return true;
+    }
+
+    bool stmtIsPure(const Stmt &stmt) const
+    {
+        switch (stmt.kind)
+        {
+        case StmtKind::Purr:
+        case StmtKind::Function:
+            return false;
+        case StmtKind::Declare:
+            return stmt.scope == SlotScope::Local && exprIsPure(*stmt.value);
+        case StmtKind::Call:
+        case StmtKind::Return:
+            return !stmt.value || exprIsPure(*stmt.value);
+        case StmtKind::If:
+            return exprIsPure(*stmt.value) && blockIsPure(stmt.body) && blockIsPure(stmt.elseBody);
+        case StmtKind::While:
+            return (!stmt.init || stmtIsPure(*stmt.init)) && exprIsPure(*stmt.value) && blockIsPure(stmt.body) &&
+                   (!stmt.step || stmtIsPure(*stmt.step));
+        }
+        return false;
+    }
+
+    bool blockIsPure(const Block &block) const
+    {
+        for (const StmtPtr &stmt : block)
+            if (!stmtIsPure(*stmt))
+                return false;
+        return true;
+    }
+
+    // every function starts out pure and loses it until nothing changes, so
+    // (mutually) recursive pure functions stay pure
+    void run(Program &program)
+    {
+        for (const StmtPtr &stmt : program)
+        {
+            if (stmt->kind == StmtKind::Function)
+            {
+                stmt->pure = stmt->globalSeeds.empty();
+                definitions[stmt->name].push_back(stmt);
+            }
+        }
+        for (bool changed = true; changed;)
+        {
+            changed = false;
+            for (auto &entry : definitions)
+            {
+                for (Stmt *def : entry.second)
+                {
+                    if (def->pure && !blockIsPure(def->body))
+                    {
+                        def->pure = false;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        for (const StmtPtr &stmt : program)
+        {
+            if (stmt->kind == StmtKind::Function && stmt->declaredPure && !stmt->pure)
+                errorStream() << "Function " << atomName(stmt->name) << " on line " << stmt->line
+                              << " is declared pure but prints, uses globals or calls an impure function; it is not memoized" << std::endl;
+        }
+    }
+};
+
+// whether calls to a definition go through the memo cache
+inline bool memoizes(bool pure, bool declaredPure)
+{
+    return pure && (declaredPure || memoizeAll);
+}
+
+// --- Bounded LRU cache of call results ---
+// Keys are the function's identity followed by the argument values' bytes.
+struct MemoCache
+{
+    size_t capacity = 65536; // --memo-size
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+
+    // most recently used first; the index views the keys stored in the list
+    std::list<std::pair<std::string, CatValue>> order;
+    std::unordered_map<std::string_view, std::list<std::pair<std::string, CatValue>>::iterator> index;
+
+    static void makeKey(std::string &key, uint64_t function, const CatValue *args, size_t count)
+    {
+        key.assign((const char *)&function, sizeof function);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const CatValue &arg = args[i];
+            key += (char)arg.type();
+            switch (arg.type())
+            {
+            case CatValue::Tag::Num:
+            {
+                double num = arg.asNumber();
+                key.append((const char *)&num, sizeof num);
+                break;
+            }
+            case CatValue::Tag::Bool:
+                key += arg.asBool() ? '1' : '0';
+                break;
+            case CatValue::Tag::Str:
+            {
+                uint32_t size = (uint32_t)arg.asString().size();
+                key.append((const char *)&size, sizeof size);
+                key += arg.asString();
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    const CatValue *find(const std::string &key)
+    {
+        auto it = index.find(key);
+        if (it == index.end())
+        {
+            ++misses;
+            return nullptr;
+        }
+        ++hits;
+        order.splice(order.begin(), order, it->second);
+        return &it->second->second;
+    }
+
+    void insert(std::string key, const CatValue &result)
+    {
+        if (capacity == 0 || index.count(key))
+            return;
+        if (order.size() >= capacity)
+        {
+            index.erase(order.back().first);
+            order.pop_back();
+            ++evictions;
+        }
+        order.emplace_front(std::move(key), result);
+        index.emplace(order.front().first, order.begin());
+    }
+
+    void printStats(std::ostream &out) const
+    {
+        out << "memo: " << hits << " hits, " << misses << " misses, " << evictions << " evictions, "
+            << order.size() << " entries" << std::endl;
+    }
+};
+
+MemoCache memoCache;
@@ -0,0 +1,102 @@
+#pragma once
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+// --- When buffered purr output is written to stdout ---
+enum class FlushPolicy
+{
+    Line, // after every purr that ends a line (default on a terminal)
+    Full, // whenever the buffer fills up (default for files and pipes)
+    None  // only at exit or when an error is reported
+};
+
+// --- Buffered sink for everything a script prints ---
+// purr output collects in one userspace buffer and reaches stdout with a single
+// write(2) per flush instead of one (or more) per printed line.
+struct OutputSink
+{
+    static const size_t capacity = 64 * 1024;
+
+    std::string buffer;
+    FlushPolicy policy;
+    int fd = STDOUT_FILENO; // where flushed output goes
+
+    OutputSink() : policy(isatty(STDOUT_FILENO) ? FlushPolicy::Line : FlushPolicy::Full)
+    {
+        buffer.reserve(capacity);
+    }
+
+    ~OutputSink()
+    {
+        flush();
+    }
+
+    void write(const char *data, size_t length)
+    {
+        size_t from = buffer.size();
+        buffer.append(data, length);
+        commit(from);
+    }
+
+    void write(const std::string &text)
+    {
+        write(text.data(), text.size());
+    }
+
+    // Applies the flush policy after text was appended to buffer directly,
+    // starting at offset from.
+    void commit(size_t from)
+    {
+        if (policy == FlushPolicy::None)
+            return;
+        if (buffer.size() >= capacity ||
+            (policy == FlushPolicy::Line && std::memchr(buffer.data() + from, '\n', buffer.size() - from)))
+            flush();
+    }
+
+    void flush()
+    {
+        size_t done = 0;
+        while (done < buffer.size())
+        {
+            ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break; // stdout is gone (closed pipe, full disk); drop the output
+            done += (size_t)n;
+        }
+        buffer.clear();
+    }
+};
+
+OutputSink output;
+
+// --- Parse a --flush= value; false if it is not line, full or none ---
+inline bool parseFlushPolicy(const std::string &name, FlushPolicy &policy)
+{
+    if (name == "line")
+        policy = FlushPolicy::Line;
+    else if (name == "full")
+        policy = FlushPolicy::Full;
+    else if (name == "none")
+        policy = FlushPolicy::None;
+    else
+        return false;
+    return true;
+}
+
+// number of diagnostics reported so far
+size_t errorsReported = 0;
+
+// --- Stream for diagnostics ---
+// Pending output is flushed first so messages appear after what was printed before them.
+inline std::ostream &errorStream()
+{
+    ++errorsReported;
+    output.flush();
+    return std::cerr;
+}
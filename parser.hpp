@@ -0,0 +1,513 @@
+#pragma once
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+#include "lexer.hpp"
+#include "ast.hpp"
+#include "output.hpp"
+
+// --- Recursive-descent parser: tokens -> Program ---
+// Syntax errors are reported per statement; the parser then skips the rest
+// of the offending line and carries on, so one bad line does not lose the script.
+struct Parser
+{
+    std::string_view source;
+    std::vector<Token> tokens;
+    size_t pos = 0;
+    std::string returnType; // of the function being parsed, empty at top level
+    int firstLine;          // line number of the start of source
+    int errorLine = 0;      // line of the last syntax error, 0 if none
+
+    explicit Parser(std::string_view src, int line = 1) : source(src), tokens(tokenize(src, line)), firstLine(line) {}
+
+    const Token &peek(size_t ahead = 0) const
+    {
+        size_t i = pos + ahead;
+        return i < tokens.size() ? tokens[i] : tokens.back();
+    }
+
+    bool check(TokenType type, size_t ahead = 0) const { return peek(ahead).type == type; }
+
+    bool match(TokenType type)
+    {
+        if (!check(type))
+            return false;
+        ++pos;
+        return true;
+    }
+
+    const Token &expect(TokenType type, const char *what)
+    {
+        if (!check(type))
+            throw std::runtime_error(std::string("expected ") + what);
+        return tokens[pos++];
+    }
+
+    static bool isTypeToken(TokenType type)
+    {
+        return type == TokenType::Num || type == TokenType::Str || type == TokenType::Bool || type == TokenType::Void;
+    }
+
+    // source text of the given line, for diagnostics
+    std::string lineText(int line) const
+    {
+        size_t start = 0;
+        for (int l = firstLine; l < line && start != std::string::npos; ++l)
+        {
+            start = source.find('\n', start);
+            if (start != std::string::npos)
+                ++start;
+        }
+        if (start == std::string::npos)
+            return std::string();
+        size_t end = source.find('\n', start);
+        std::string text(source.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        text.erase(0, text.find_first_not_of(" \t\r"));
+        text.erase(text.find_last_not_of(" \t\r") + 1);
+        return text;
+    }
+
+    // skip the remainder of a broken statement's line
+    void synchronize(int line)
+    {
+        while (!check(TokenType::End) && peek().line == line)
+            ++pos;
+    }
+
+    // --- Program ---
+    Program parseProgram()
+    {
+        Program program(&astArena);
+        while (!check(TokenType::End))
+        {
+            int line = peek().line;
+            try
+            {
+                if (isTypeToken(peek().type) && check(TokenType::Identifier, 1) && check(TokenType::LParen, 2))
+                    program.push_back(parseFunction());
+                else if (check(TokenType::Identifier) && peek().text == "pure" && isTypeToken(peek(1).type) &&
+                         check(TokenType::Identifier, 2) && check(TokenType::LParen, 3))
+                {
+                    ++pos; // 'pure' is only a modifier in front of a function header
+                    program.push_back(parseFunction());
+                    program.back()->declaredPure = true;
+                }
+                else
+                    program.push_back(parseStatement());
+            }
+            catch (const std::runtime_error &e)
+            {
+                returnType.clear();
+                reportError(line, e.what());
+            }
+        }
+        return program;
+    }
+
+    void reportError(int line, const std::string &message)
+    {
+        errorStream() << "Syntax error on line " << line << " (" << message << "): " << lineText(line) << std::endl;
+        errorLine = line;
+        synchronize(line);
+    }
+
+    // --- Function definition: [pure] type name(type a, type b) { ... } ---
+    StmtPtr parseFunction()
+    {
+        auto stmt = astArena.create<Stmt>();
+        stmt->kind = StmtKind::Function;
+        stmt->line = peek().line;
+        stmt->type = typeName(tokens[pos++].text);
+        stmt->name = intern(expect(TokenType::Identifier, "function name").text);
+        expect(TokenType::LParen, "'('");
+        if (!check(TokenType::RParen))
+        {
+            do
+            {
+                const Token &type = peek();
+                if (!isTypeToken(type.type) || type.type == TokenType::Void)
+                    throw std::runtime_error("expected parameter type");
+                ++pos;
+                stmt->params.push_back({typeName(type.text), intern(expect(TokenType::Identifier, "parameter name").text)});
+            } while (match(TokenType::Comma));
+        }
+        expect(TokenType::RParen, "')'");
+
+        returnType = stmt->type;
+        stmt->body = parseBlock();
+        returnType.clear();
+        return stmt;
+    }
+
+    // --- { statements } ---
+    Block parseBlock()
+    {
+        expect(TokenType::LBrace, "'{'");
+        Block block(&astArena);
+        while (!check(TokenType::RBrace))
+        {
+            if (check(TokenType::End))
+                throw std::runtime_error("missing closing '}'");
+            int line = peek().line;
+            try
+            {
+                block.push_back(parseStatement());
+            }
+            catch (const std::runtime_error &e)
+            {
+                reportError(line, e.what());
+            }
+        }
+        ++pos; // '}'
+        return block;
+    }
+
+    // --- Statements ---
+    StmtPtr parseStatement()
+    {
+        switch (peek().type)
+        {
+        case TokenType::Num:
+        case TokenType::Str:
+        case TokenType::Bool:
+        case TokenType::Identifier:
+        {
+            StmtPtr stmt = parseSimpleStatement();
+            expect(TokenType::Semicolon, "';'");
+            return stmt;
+        }
+
+        case TokenType::If:
+            return parseIf();
+
+        case TokenType::While:
+        case TokenType::For:
+            return parseLoop();
+
+        default:
+            break;
+        }
+
+        auto stmt = astArena.create<Stmt>();
+        stmt->line = peek().line;
+
+        switch (peek().type)
+        {
+        case TokenType::Purr:
+            ++pos;
+            expect(TokenType::Arrow, "'~>'");
+            stmt->kind = StmtKind::Purr;
+            stmt->value = parseConcat();
+            expect(TokenType::Semicolon, "';'");
+            return stmt;
+
+        case TokenType::Return:
+            if (returnType.empty())
+                throw std::runtime_error("return outside of a function");
+            ++pos;
+            stmt->kind = StmtKind::Return;
+            if (!check(TokenType::Semicolon))
+                stmt->value = returnType == "str" ? parseConcat() : parseExpression();
+            expect(TokenType::Semicolon, "';'");
+            return stmt;
+
+        default:
+            break;
+        }
+        throw std::runtime_error("unknown command");
+    }
+
+    // declaration or call, without its ';' (also the init and step of a for loop)
+    StmtPtr parseSimpleStatement()
+    {
+        auto stmt = astArena.create<Stmt>();
+        stmt->line = peek().line;
+        if (check(TokenType::Identifier))
+        {
+            if (!check(TokenType::LParen, 1))
+                throw std::runtime_error("unknown command");
+            stmt->kind = StmtKind::Call;
+            stmt->value = parsePrimary();
+            return stmt;
+        }
+        if (!isTypeToken(peek().type) || check(TokenType::Void))
+            throw std::runtime_error("expected a declaration or a call");
+        if (check(TokenType::LParen, 2))
+            throw std::runtime_error("functions can only be defined at top level");
+        stmt->kind = StmtKind::Declare;
+        stmt->type = typeName(tokens[pos++].text);
+        stmt->name = intern(expect(TokenType::Identifier, "variable name").text);
+        expect(TokenType::Arrow, "'~>'");
+        stmt->value = stmt->type == "str" ? parseConcat() : parseExpression();
+        return stmt;
+    }
+
+    // while (cond) { ... }
+    // for (init; cond; step) { ... }  -- init and step are a declaration or a call, each optional
+    StmtPtr parseLoop()
+    {
+        auto stmt = astArena.create<Stmt>();
+        stmt->kind = StmtKind::While;
+        stmt->line = peek().line;
+        bool isFor = tokens[pos++].type == TokenType::For;
+        expect(TokenType::LParen, "'('");
+        if (isFor)
+        {
+            if (!check(TokenType::Semicolon))
+                stmt->init = parseSimpleStatement();
+            expect(TokenType::Semicolon, "';'");
+            if (check(TokenType::Semicolon))
+            {
+                // no condition: loop until a return
+                stmt->value = makeExpr(ExprKind::Bool, stmt->line);
+                stmt->value->boolean = true;
+            }
+            else
+                stmt->value = parseExpression();
+            expect(TokenType::Semicolon, "';'");
+            if (!check(TokenType::RParen))
+                stmt->step = parseSimpleStatement();
+        }
+        else
+            stmt->value = parseExpression();
+        expect(TokenType::RParen, "')'");
+        stmt->body = parseBlock();
+        return stmt;
+    }
+
+    // if (cond) { ... } [else { ... } | else if ...]
+    StmtPtr parseIf()
+    {
+        auto stmt = astArena.create<Stmt>();
+        stmt->kind = StmtKind::If;
+        stmt->line = peek().line;
+        ++pos; // if
+        expect(TokenType::LParen, "'('");
+        stmt->value = parseExpression();
+        expect(TokenType::RParen, "')'");
+        stmt->body = parseBlock();
+        if (match(TokenType::Else))
+        {
+            if (check(TokenType::If))
+                stmt->elseBody.push_back(parseIf());
+            else
+                stmt->elseBody = parseBlock();
+        }
+        return stmt;
+    }
+
+    // --- Expressions ---
+    static ExprPtr makeExpr(ExprKind kind, int line)
+    {
+        auto expr = astArena.create<Expr>();
+        expr->kind = kind;
+        expr->line = line;
+        return expr;
+    }
+
+    static ExprPtr makeBinary(BinaryOp op, ExprPtr lhs, ExprPtr rhs)
+    {
+        auto expr = makeExpr(ExprKind::Binary, lhs->line);
+        expr->op = op;
+        expr->operands.push_back(lhs);
+        expr->operands.push_back(rhs);
+        return expr;
+    }
+
+    static ExprPtr makeLogical(ExprKind kind, int line, ExprPtr lhs, ExprPtr rhs)
+    {
+        auto expr = makeExpr(kind, line);
+        expr->operands.push_back(lhs);
+        expr->operands.push_back(rhs);
+        return expr;
+    }
+
+    // purr / str values: parts joined by '+' are concatenated as text
+    ExprPtr parseConcat()
+    {
+        ExprPtr first = parseTerm();
+        if (!check(TokenType::Plus))
+            return first;
+        auto concat = makeExpr(ExprKind::Concat, first->line);
+        concat->operands.push_back(first);
+        while (match(TokenType::Plus))
+            concat->operands.push_back(parseTerm());
+        return concat;
+    }
+
+    // logical operators: || binds looser than &&, both over comparisons
+    ExprPtr parseExpression()
+    {
+        ExprPtr lhs = parseAnd();
+        while (check(TokenType::OrOr))
+        {
+            int line = tokens[pos++].line;
+            lhs = makeLogical(ExprKind::Or, line, lhs, parseAnd());
+        }
+        return lhs;
+    }
+
+    ExprPtr parseAnd()
+    {
+        ExprPtr lhs = parseComparison();
+        while (check(TokenType::AndAnd))
+        {
+            int line = tokens[pos++].line;
+            lhs = makeLogical(ExprKind::And, line, lhs, parseComparison());
+        }
+        return lhs;
+    }
+
+    // comparison (non-associative) over arithmetic
+    ExprPtr parseComparison()
+    {
+        ExprPtr lhs = parseAdditive();
+        BinaryOp op;
+        switch (peek().type)
+        {
+        case TokenType::Equal:
+            op = BinaryOp::Equal;
+            break;
+        case TokenType::NotEqual:
+            op = BinaryOp::NotEqual;
+            break;
+        case TokenType::Less:
+            op = BinaryOp::Less;
+            break;
+        case TokenType::Greater:
+            op = BinaryOp::Greater;
+            break;
+        case TokenType::LessEqual:
+            op = BinaryOp::LessEqual;
+            break;
+        case TokenType::GreaterEqual:
+            op = BinaryOp::GreaterEqual;
+            break;
+        default:
+            return lhs;
+        }
+        ++pos;
+        return makeBinary(op, lhs, parseAdditive());
+    }
+
+    ExprPtr parseAdditive()
+    {
+        ExprPtr lhs = parseTerm();
+        while (check(TokenType::Plus) || check(TokenType::Minus))
+        {
+            BinaryOp op = tokens[pos++].type == TokenType::Plus ? BinaryOp::Add : BinaryOp::Sub;
+            lhs = makeBinary(op, lhs, parseTerm());
+        }
+        return lhs;
+    }
+
+    ExprPtr parseTerm()
+    {
+        ExprPtr lhs = parsePrimary();
+        while (check(TokenType::Star) || check(TokenType::Slash))
+        {
+            BinaryOp op = tokens[pos++].type == TokenType::Star ? BinaryOp::Mul : BinaryOp::Div;
+            lhs = makeBinary(op, lhs, parsePrimary());
+        }
+        return lhs;
+    }
+
+    ExprPtr parsePrimary()
+    {
+        const Token &tok = peek();
+        switch (tok.type)
+        {
+        case TokenType::NumberLiteral:
+        {
+            ++pos;
+            auto expr = makeExpr(ExprKind::Number, tok.line);
+            auto result = std::from_chars(tok.text.data(), tok.text.data() + tok.text.size(), expr->number);
+            if (result.ec == std::errc::result_out_of_range)
+                throw std::runtime_error("number out of range");
+            return expr;
+        }
+        case TokenType::Minus:
+        {
+            // unary minus; a negative numeric literal stays a literal
+            ++pos;
+            ExprPtr operand = parsePrimary();
+            if (operand->kind == ExprKind::Number)
+            {
+                operand->number = -operand->number;
+                return operand;
+            }
+            auto expr = makeExpr(ExprKind::Negate, tok.line);
+            expr->operands.push_back(operand);
+            return expr;
+        }
+        case TokenType::Bang:
+        {
+            ++pos;
+            auto expr = makeExpr(ExprKind::Not, tok.line);
+            expr->operands.push_back(parsePrimary());
+            return expr;
+        }
+        case TokenType::StringLiteral:
+        {
+            ++pos;
+            auto expr = makeExpr(ExprKind::String, tok.line);
+            expr->text = tok.text; // points into the source
+            return expr;
+        }
+        case TokenType::Endl:
+        {
+            ++pos;
+            auto expr = makeExpr(ExprKind::String, tok.line);
+            expr->text = "\n";
+            return expr;
+        }
+        case TokenType::BoolLiteral:
+        {
+            ++pos;
+            auto expr = makeExpr(ExprKind::Bool, tok.line);
+            expr->boolean = tok.text[0] == 't' || tok.text[0] == 'T';
+            return expr;
+        }
+        case TokenType::Identifier:
+        {
+            ++pos;
+            if (!match(TokenType::LParen))
+            {
+                auto expr = makeExpr(ExprKind::Variable, tok.line);
+                expr->name = intern(tok.text);
+                return expr;
+            }
+            auto call = makeExpr(ExprKind::Call, tok.line);
+            call->name = intern(tok.text);
+            if (!check(TokenType::RParen))
+            {
+                do
+                    call->operands.push_back(parseExpression());
+                while (match(TokenType::Comma));
+            }
+            expect(TokenType::RParen, "')'");
+            return call;
+        }
+        case TokenType::LParen:
+        {
+            ++pos;
+            ExprPtr inner = parseExpression();
+            expect(TokenType::RParen, "')'");
+            return inner;
+        }
+        default:
+            break;
+        }
+        throw std::runtime_error("unexpected '" + std::string(source.substr(tok.pos, tok.length)) + "'");
+    }
+};
+
+// --- Parse a whole script ---
+inline Program parseProgram(std::string_view source)
+{
+    Parser parser(source);
+    return parser.parseProgram();
+}
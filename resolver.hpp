@@ -0,0 +1,454 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <iostream>
+#include "ast.hpp"
+#include "memo.hpp"
+#include "output.hpp"
+#include "value.hpp"
+
+// --- Typed slot of a frame ---
+struct SlotInfo
+{
+    Atom name;
+    std::string_view type; // type of the first declaration: "num", "str", "bool"
+};
+
+// --- Global frame layout produced by the resolver ---
+struct FrameLayout
+{
+    std::vector<SlotInfo> slots;
+    std::vector<unsigned> types; // per slot: every type declared for it, as Resolver::typeBit() values
+};
+
+// --- Resolution pass ---
+// Binds every identifier to a slot index once, at load time:
+//   - globals (every name declared outside functions) get global slots 0..n-1
+//   - a function's call frame holds only its parameters and locals (local slots
+//     0..m-1); other names fall back to the global frame. A local that shadows a
+//     global is seeded with the global's value when the call starts.
+// Undefined variables are reported here, once, and evaluate to nothing at run time.
+// In purr, an unknown bare word becomes a literal, matching the old fallback.
+// Expressions that can never produce a str are marked numeric, from the types
+// declared for each slot and the return types of every definition of a function.
+// Each purr is also turned into a template: literal parts are pre-formatted and
+// adjacent ones merged, leaving literal chunks and variable/expression references.
+// Finally every function is checked for purity (see memo.hpp).
+// A streamed script is resolved one top-level statement at a time instead (see
+// resolveStatements), with only what has been read so far to go on; its
+// functions are never treated as pure.
+struct Resolver
+{
+    FrameLayout globals;
+    std::unordered_map<Atom, int> globalSlots;
+    std::unordered_set<Atom> declaredSoFar; // top-level names declared before this point
+
+    bool inFunction = false;
+    std::unordered_map<Atom, int> locals;
+    int frameSize = 0;
+
+    // types a slot can hold, as a mask of typeBit() values
+    std::vector<unsigned> globalTypes;
+    std::vector<unsigned> localTypes;
+    std::unordered_set<Atom> textFunctions; // names with a str definition
+
+    // streaming: a function body may use a global declared further down the stream
+    bool streaming = false;
+    std::vector<Stmt *> definitions;              // function definitions resolved so far
+    std::vector<std::pair<Atom, int>> forwardUses; // names a function used before any declaration, with the line
+
+    static constexpr unsigned anyType = 1 | 2 | 4;
+
+    static unsigned typeBit(std::string_view type)
+    {
+        if (type == "num")
+            return 1;
+        if (type == "str")
+            return 2;
+        if (type == "bool")
+            return 4;
+        return 0;
+    }
+
+    bool slotIsNumeric(const Expr &expr) const
+    {
+        if (expr.slot < 0)
+            return true; // evaluates to nothing
+        const std::vector<unsigned> &types = expr.scope == SlotScope::Local ? localTypes : globalTypes;
+        return !(types[expr.slot] & typeBit("str"));
+    }
+
+    int addGlobal(Atom name, std::string_view type)
+    {
+        auto it = globalSlots.find(name);
+        if (it != globalSlots.end())
+            return it->second;
+        globals.slots.push_back({name, type});
+        return globalSlots[name] = (int)globals.slots.size() - 1;
+    }
+
+    // global slot for a name a function uses before its declaration; it holds
+    // nothing until the declaration runs and is assumed to be of any type
+    int reserveGlobal(Atom name, int line)
+    {
+        int slot = addGlobal(name, std::string_view());
+        globalTypes.resize(globals.slots.size(), anyType);
+        if (line > 0)
+            forwardUses.push_back({name, line});
+        return slot;
+    }
+
+    // slot of a name at the current point, -1 if it is not defined
+    int lookup(Atom name, SlotScope &scope) const
+    {
+        scope = SlotScope::Global;
+        if (inFunction)
+        {
+            auto it = locals.find(name);
+            if (it != locals.end())
+            {
+                scope = SlotScope::Local;
+                return it->second;
+            }
+            auto git = globalSlots.find(name);
+            return git != globalSlots.end() ? git->second : -1;
+        }
+        if (!declaredSoFar.count(name))
+            return -1;
+        return globalSlots.at(name);
+    }
+
+    void resolveExpr(Expr &expr, bool inPurr = false)
+    {
+        switch (expr.kind)
+        {
+        case ExprKind::Variable:
+            expr.slot = lookup(expr.name, expr.scope);
+            if (expr.slot < 0 && inFunction && streaming)
+                expr.slot = reserveGlobal(expr.name, inPurr ? 0 : expr.line); // a purr prints the name until then
+            if (expr.slot < 0)
+            {
+                if (inPurr)
+                {
+                    expr.kind = ExprKind::String; // bare word, printed as written
+                    expr.text = atomName(expr.name);
+                    return;
+                }
+                errorStream() << "Undefined variable on line " << expr.line << ": " << atomName(expr.name) << std::endl;
+            }
+            expr.numeric = slotIsNumeric(expr);
+            return;
+        case ExprKind::Concat:
+            for (ExprPtr &part : expr.operands)
+                resolveExpr(*part, inPurr);
+            return;
+        default:
+            for (ExprPtr &operand : expr.operands)
+                resolveExpr(*operand);
+            break;
+        }
+
+        switch (expr.kind)
+        {
+        case ExprKind::Number:
+        case ExprKind::Bool:
+        case ExprKind::Negate:
+        case ExprKind::Not:
+        case ExprKind::And:
+        case ExprKind::Or:
+            expr.numeric = true;
+            break;
+        case ExprKind::Call:
+            expr.numeric = !textFunctions.count(expr.name);
+            break;
+        case ExprKind::Binary:
+            // '+' joins text when either side is a str; every other operator yields a num or bool
+            expr.numeric = expr.op != BinaryOp::Add || (expr.operands[0]->numeric && expr.operands[1]->numeric);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void resolveBlock(Block &block)
+    {
+        for (StmtPtr &stmt : block)
+            resolveStatement(*stmt);
+    }
+
+    void resolveStatement(Stmt &stmt)
+    {
+        switch (stmt.kind)
+        {
+        case StmtKind::Purr:
+            resolveExpr(*stmt.value, true);
+            compilePurrTemplate(stmt.value);
+            stmt.printsDirect = !containsCall(*stmt.value);
+            return;
+
+        case StmtKind::Declare:
+            resolveExpr(*stmt.value);
+            if (inFunction)
+            {
+                stmt.slot = locals.at(stmt.name);
+                stmt.scope = SlotScope::Local;
+            }
+            else
+            {
+                stmt.slot = globalSlots.at(stmt.name);
+                declaredSoFar.insert(stmt.name);
+            }
+            return;
+
+        case StmtKind::Call:
+        case StmtKind::Return:
+            if (stmt.value)
+                resolveExpr(*stmt.value);
+            return;
+
+        case StmtKind::If:
+            resolveExpr(*stmt.value);
+            resolveBlock(stmt.body);
+            resolveBlock(stmt.elseBody);
+            return;
+
+        case StmtKind::While:
+            if (stmt.init)
+                resolveStatement(*stmt.init);
+            resolveExpr(*stmt.value);
+            resolveBlock(stmt.body);
+            if (stmt.step)
+                resolveStatement(*stmt.step);
+            return;
+
+        case StmtKind::Function:
+            resolveFunction(stmt);
+            return;
+        }
+    }
+
+    void resolveFunction(Stmt &stmt)
+    {
+        inFunction = true;
+        locals.clear();
+        localTypes.clear();
+        frameSize = 0;
+        stmt.globalSeeds.clear();
+
+        auto bind = [&](Atom name, std::string_view type)
+        {
+            auto it = locals.find(name);
+            int slot = it != locals.end() ? it->second : (locals[name] = frameSize++);
+            if ((int)localTypes.size() < frameSize)
+                localTypes.resize(frameSize, 0);
+            localTypes[slot] |= typeBit(type);
+            return slot;
+        };
+
+        // parameters and every name the body declares are locals for the whole body
+        for (FuncArg &param : stmt.params)
+            param.slot = bind(param.name, param.type);
+        std::vector<const Stmt *> declared;
+        collectDeclarationStmts(stmt.body, declared);
+        for (const Stmt *decl : declared)
+        {
+            bool isNew = !locals.count(decl->name);
+            int slot = bind(decl->name, decl->type);
+            auto git = globalSlots.find(decl->name);
+            if (isNew && git != globalSlots.end())
+            {
+                stmt.globalSeeds.push_back({slot, git->second});
+                localTypes[slot] |= globalTypes[git->second];
+            }
+        }
+
+        resolveBlock(stmt.body);
+        stmt.frameSize = frameSize;
+        inFunction = false;
+    }
+
+    // --- Names that exist before the script starts (restored from a snapshot) ---
+    // Globals keep their slots and types and count as declared before the first line.
+    void predeclare(const FrameLayout &layout, const std::vector<Atom> &strFunctions)
+    {
+        for (size_t i = 0; i < layout.slots.size(); ++i)
+        {
+            int slot = addGlobal(layout.slots[i].name, layout.slots[i].type);
+            globalTypes.resize(globals.slots.size(), 0);
+            globalTypes[slot] |= i < layout.types.size() ? layout.types[i] : anyType;
+            declaredSoFar.insert(layout.slots[i].name);
+        }
+        textFunctions.insert(strFunctions.begin(), strFunctions.end());
+    }
+
+    void resolveProgram(Program &program)
+    {
+        // every name declared outside functions is a global
+        std::vector<const Stmt *> decls;
+        collectDeclarationStmts(program, decls);
+        for (const Stmt *decl : decls)
+        {
+            int slot = addGlobal(decl->name, decl->type);
+            globalTypes.resize(globals.slots.size(), 0);
+            globalTypes[slot] |= typeBit(decl->type);
+        }
+        for (const StmtPtr &stmt : program)
+        {
+            if (stmt->kind == StmtKind::Function && stmt->type == "str")
+                textFunctions.insert(stmt->name);
+        }
+        resolveBlock(program);
+        globals.types = globalTypes;
+        PurityAnalysis().run(program);
+    }
+
+    // --- Streaming: resolve the statements just read ---
+    // Globals and function return types are known only up to this point. When a
+    // declaration widens the type of a global (or a str definition appears for a
+    // function) that earlier function bodies may have relied on, those bodies are
+    // resolved again. Returns true when the statements must be kept after they run:
+    // they define a function, or earlier definitions now point into them.
+    bool resolveStatements(Program &stmts)
+    {
+        size_t known = globals.slots.size();
+        bool widened = false;
+        std::vector<const Stmt *> decls;
+        collectDeclarationStmts(stmts, decls);
+        for (const Stmt *decl : decls)
+        {
+            int slot = addGlobal(decl->name, decl->type);
+            globalTypes.resize(globals.slots.size(), 0);
+            unsigned before = globalTypes[slot];
+            globalTypes[slot] |= typeBit(decl->type);
+            widened = widened || ((size_t)slot < known && globalTypes[slot] != before);
+        }
+
+        bool keep = false;
+        for (const StmtPtr &stmt : stmts)
+        {
+            if (stmt->kind != StmtKind::Function)
+                continue;
+            keep = true;
+            if (stmt->type == "str" && textFunctions.insert(stmt->name).second)
+                widened = true;
+        }
+        if (widened && !definitions.empty())
+        {
+            for (Stmt *def : definitions)
+                resolveFunction(*def);
+            keep = true;
+        }
+
+        resolveBlock(stmts);
+        for (const StmtPtr &stmt : stmts)
+        {
+            if (stmt->kind == StmtKind::Function)
+                definitions.push_back(stmt);
+        }
+        return keep;
+    }
+
+    // streaming: names functions used that the whole stream never declared
+    void reportUndeclared() const
+    {
+        for (const auto &use : forwardUses)
+        {
+            if (!declaredSoFar.count(use.first))
+                errorStream() << "Undefined variable on line " << use.second << ": " << atomName(use.first) << std::endl;
+        }
+    }
+
+    // appends the text of a literal purr part; false if the part is not a literal
+    static bool literalText(const Expr &part, std::string &text)
+    {
+        switch (part.kind)
+        {
+        case ExprKind::String:
+            text += part.text;
+            return true;
+        case ExprKind::Number:
+            text += formatNumber(part.number);
+            return true;
+        case ExprKind::Bool:
+            text += part.boolean ? "true" : "false";
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // merges runs of literal parts into single String chunks
+    static void compilePurrTemplate(ExprPtr &value)
+    {
+        std::string text;
+        if (value->kind != ExprKind::Concat)
+        {
+            if (literalText(*value, text))
+            {
+                value->kind = ExprKind::String;
+                value->text = astArena.copy(text);
+            }
+            return;
+        }
+
+        std::pmr::vector<ExprPtr> chunks(&astArena);
+        ExprPtr run = nullptr; // String chunk collecting the current run of literals
+        for (ExprPtr part : value->operands)
+        {
+            if (literalText(*part, text))
+            {
+                if (!run)
+                {
+                    run = part;
+                    run->kind = ExprKind::String;
+                    chunks.push_back(run);
+                }
+                continue;
+            }
+            if (run)
+                run->text = astArena.copy(text);
+            run = nullptr;
+            text.clear();
+            chunks.push_back(part);
+        }
+        if (run)
+            run->text = astArena.copy(text);
+
+        if (chunks.size() == 1)
+            value = chunks[0];
+        else
+            value->operands = std::move(chunks);
+    }
+
+    static void collectDeclarationStmts(const Block &block, std::vector<const Stmt *> &out)
+    {
+        for (const StmtPtr &stmt : block)
+        {
+            if (stmt->kind == StmtKind::Declare)
+                out.push_back(stmt);
+            else if (stmt->kind == StmtKind::If)
+            {
+                collectDeclarationStmts(stmt->body, out);
+                collectDeclarationStmts(stmt->elseBody, out);
+            }
+            else if (stmt->kind == StmtKind::While)
+            {
+                if (stmt->init && stmt->init->kind == StmtKind::Declare)
+                    out.push_back(stmt->init);
+                collectDeclarationStmts(stmt->body, out);
+                if (stmt->step && stmt->step->kind == StmtKind::Declare)
+                    out.push_back(stmt->step);
+            }
+        }
+    }
+};
+
+// --- Resolve a parsed program; returns the global frame layout ---
+inline FrameLayout resolveProgram(Program &program)
+{
+    Resolver resolver;
+    resolver.resolveProgram(program);
+    return resolver.globals;
+}
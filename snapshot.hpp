@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bytecode.hpp"
+#include "cache.hpp"
+#include "resolver.hpp"
+#include "vm.hpp"
+
+// --- Interpreter snapshots ---
+// --snapshot-out writes the state the VM is left in after a script (typically a
+// prelude of declarations and function definitions): every global with its
+// declared types and current value, and every function compiled so far together
+// with which of them are defined. --snapshot-in maps that file back and starts the
+// next script from it, so the prelude is neither parsed nor run again.
+//
+// Globals keep their slot numbers and functions their call slots and proto
+// indices, so code from the snapshot runs unchanged next to the new script's code;
+// restoring only re-interns names and refills the tables.
+//
+// Layout (see cache.hpp for the encoding):
+//   "CATS" u32 version u64 build
+//   u32 globals: name, first declared type, u32 types, u8 set, value
+//   program (protos[0], the prelude's own top-level code, is left empty)
+//   u32 call slots: i32 proto index (-1 while undefined)
+
+struct Snapshot
+{
+    BytecodeProgram program;
+    FrameLayout globals;
+    std::vector<CatValue> values;
+    std::vector<bool> set;
+    std::vector<int> functionSlots;
+
+    // names of functions with a str definition, for the resolver
+    std::vector<Atom> textFunctions() const
+    {
+        std::vector<Atom> names;
+        for (size_t i = 1; i < program.protos.size(); ++i)
+        {
+            if (program.protos[i].returnType == "str")
+                names.push_back(intern(program.protos[i].name));
+        }
+        return names;
+    }
+
+    // starts a VM (built over a program compiled on top of this one) from the saved state
+    void restore(VM &vm) const
+    {
+        for (size_t i = 0; i < values.size() && i < vm.globals.size(); ++i)
+        {
+            vm.globals[i] = values[i];
+            vm.globalSet[i] = set[i];
+        }
+        for (size_t i = 0; i < functionSlots.size() && i < vm.functionSlots.size(); ++i)
+            vm.define(i, functionSlots[i]);
+    }
+};
+
+inline bool saveSnapshot(const std::string &path, const BytecodeProgram &program, const FrameLayout &globals, const VM &vm)
+{
+    CacheWriter w;
+    writeHeader(w, "CATS");
+
+    w.u32((uint32_t)globals.slots.size());
+    for (size_t i = 0; i < globals.slots.size(); ++i)
+    {
+        w.str(atomName(globals.slots[i].name));
+        w.str(globals.slots[i].type);
+        w.u32(i < globals.types.size() ? globals.types[i] : Resolver::anyType);
+        w.u8(vm.globalSet[i]);
+        w.value(vm.globals[i]);
+    }
+
+    BytecodeProgram functions = program;
+    functions.protos[0] = Proto();
+    writeProgram(w, functions);
+
+    w.u32((uint32_t)vm.functionSlots.size());
+    for (int proto : vm.functionSlots)
+        w.i32(proto);
+    return writeFileAtomically(path, w.out);
+}
+
+inline bool loadSnapshot(const std::string &path, Snapshot &snapshot)
+{
+    SourceFile file;
+    if (!file.open(path))
+        return false;
+    CacheReader r{file.data, file.data + file.size};
+    if (!readHeader(r, "CATS"))
+        return false;
+
+    for (uint32_t n = r.count(14); n > 0; --n)
+    {
+        Atom name = intern(r.str());
+        std::string_view type = typeName(r.str());
+        snapshot.globals.slots.push_back({name, type});
+        snapshot.globals.types.push_back(r.u32());
+        snapshot.set.push_back(r.u8() != 0);
+        snapshot.values.push_back(r.value());
+    }
+    if (!readProgram(r, snapshot.program))
+        return false;
+    for (uint32_t n = r.count(4); n > 0; --n)
+    {
+        int proto = r.i32();
+        if (proto >= (int)snapshot.program.protos.size())
+            r.ok = false;
+        snapshot.functionSlots.push_back(proto);
+    }
+    return r.ok && r.at == r.end && snapshot.program.globalNames.size() == snapshot.globals.slots.size() &&
+           snapshot.functionSlots.size() == snapshot.program.functionNames.size();
+}
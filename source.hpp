@@ -0,0 +1,254 @@
+#pragma once
+#include <cerrno>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lexer.hpp"
+
+// --- Script inputs ---
+// "-" is standard input; anything else is a path.
+inline int openInput(const std::string &path)
+{
+    return path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+}
+
+// true for inputs that arrive over time (stdin, named pipes, devices) and are
+// read statement by statement rather than mapped
+inline bool isStreamInput(const std::string &path)
+{
+    if (path == "-")
+        return true;
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && (S_ISFIFO(info.st_mode) || S_ISCHR(info.st_mode) || S_ISSOCK(info.st_mode));
+}
+
+// --- Read-only view of a script file ---
+// Regular files are mmap'd, so loading is one page-in pass and the lexer's tokens
+// view the mapping directly. Anything that cannot be mapped (empty files, devices)
+// is read into a buffer instead. The view stays valid until the SourceFile dies.
+struct SourceFile
+{
+    const char *data = nullptr;
+    size_t size = 0;
+    void *mapping = nullptr;
+    std::string buffer; // fallback storage when the file is not mapped
+
+    SourceFile() = default;
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    ~SourceFile()
+    {
+        if (mapping)
+            munmap(mapping, size);
+    }
+
+    bool open(const std::string &path)
+    {
+        int fd = openInput(path);
+        if (fd < 0)
+            return false;
+        bool loaded = load(fd);
+        if (fd != STDIN_FILENO)
+            ::close(fd);
+        return loaded;
+    }
+
+    bool load(int fd)
+    {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+            flags |= MAP_POPULATE; // fault the whole file in up front
+#endif
+            void *map = mmap(nullptr, (size_t)info.st_size, PROT_READ, flags, fd, 0);
+            if (map != MAP_FAILED)
+            {
+                mapping = map;
+                data = (const char *)map;
+                size = (size_t)info.st_size;
+                return true;
+            }
+        }
+
+        char chunk[64 * 1024];
+        ssize_t n;
+        while ((n = ::read(fd, chunk, sizeof chunk)) > 0)
+            buffer.append(chunk, (size_t)n);
+        if (n < 0)
+            return false;
+        data = buffer.data();
+        size = buffer.size();
+        return true;
+    }
+
+    std::string_view text() const
+    {
+        return std::string_view(data, size);
+    }
+};
+
+// --- Statement-at-a-time reader for stdin and pipes ---
+// Hands out one complete top-level statement at a time, so a streamed script of
+// any length is held in memory no larger than its longest statement plus one read.
+// A statement ends at a ';' outside braces and parentheses (a for loop header has
+// two) or at the '}' that closes its last brace; after such a '}' the reader looks ahead past blanks and comments for an
+// 'else' that continues the statement. Strings and comments are skipped the way
+// the lexer skips them, so braces and ';' inside them do not count.
+struct SourceStream
+{
+    static const size_t readSize = 64 * 1024;
+
+    int fd;
+    std::string buffer;  // recent input: statements handed out, the next one and what was read past it
+    size_t consumed = 0; // where the next statement starts
+    int line = 1;        // line number at buffer[consumed]
+    bool atEnd = false;
+    bool failed = false; // a read error ended the input
+
+    explicit SourceStream(int input) : fd(input) {}
+
+    // next statement and the line it starts on; the text stays valid until the
+    // following call. False once only blanks and comments are left.
+    bool next(std::string_view &text, int &firstLine)
+    {
+        // drop statements already handed out, once there is a block's worth of them
+        if (consumed >= readSize)
+        {
+            buffer.erase(0, consumed);
+            consumed = 0;
+        }
+
+        size_t i = consumed;
+        int depth = 0;  // braces
+        int parens = 0; // parentheses
+        size_t end = std::string::npos; // just past a '}' that may have closed the statement
+        int lines = 0;                  // newlines before i
+        int endLines = 0;               // newlines before end
+        bool significant = false;
+        while (available(i + 1))
+        {
+            char c = buffer[i];
+            if (c == '\n')
+            {
+                ++lines;
+                ++i;
+                continue;
+            }
+            if (std::isspace((unsigned char)c))
+            {
+                ++i;
+                continue;
+            }
+            if (c == '/' && available(i + 2) && buffer[i + 1] == '/')
+            {
+                while (available(i + 1) && buffer[i] != '\n')
+                    ++i;
+                continue;
+            }
+            if (c == '/' && available(i + 2) && buffer[i + 1] == '*')
+            {
+                i += 2;
+                while (available(i + 2) && !(buffer[i] == '*' && buffer[i + 1] == '/'))
+                {
+                    if (buffer[i] == '\n')
+                        ++lines;
+                    ++i;
+                }
+                i = available(i + 2) ? i + 2 : buffer.size();
+                continue;
+            }
+
+            if (end != std::string::npos)
+            {
+                if (!startsElse(i))
+                    break;
+                end = std::string::npos;
+            }
+            significant = true;
+
+            if (c == '"')
+            {
+                // a literal ends at its closing quote or, unterminated, at the end of the line
+                ++i;
+                while (available(i + 1) && buffer[i] != '"' && buffer[i] != '\n')
+                    ++i;
+                if (available(i + 1) && buffer[i] == '"')
+                    ++i;
+                continue;
+            }
+            ++i;
+            if (c == '(')
+                ++parens;
+            else if (c == ')')
+                parens = parens > 0 ? parens - 1 : 0;
+            else if (c == '{')
+                ++depth;
+            else if (c == '}')
+            {
+                depth = depth > 0 ? depth - 1 : 0;
+                if (depth == 0)
+                {
+                    end = i;
+                    endLines = lines;
+                }
+            }
+            else if (c == ';' && depth == 0 && parens == 0)
+            {
+                end = i;
+                endLines = lines;
+                break;
+            }
+        }
+
+        if (!significant)
+        {
+            consumed = buffer.size();
+            return false;
+        }
+        if (end == std::string::npos)
+        {
+            // input ended inside the statement: hand out what there is
+            end = buffer.size();
+            endLines = lines;
+        }
+        text = std::string_view(buffer.data() + consumed, end - consumed);
+        firstLine = line;
+        line += endLines;
+        consumed = end;
+        return true;
+    }
+
+private:
+    // makes sure buffer holds at least n bytes; false if the input ends first
+    bool available(size_t n)
+    {
+        while (buffer.size() < n && !atEnd)
+        {
+            size_t old = buffer.size();
+            buffer.resize(old + readSize);
+            ssize_t got;
+            do
+                got = ::read(fd, &buffer[old], readSize);
+            while (got < 0 && errno == EINTR);
+            buffer.resize(old + (got > 0 ? (size_t)got : 0));
+            if (got <= 0)
+            {
+                atEnd = true;
+                failed = got < 0;
+            }
+        }
+        return buffer.size() >= n;
+    }
+
+    bool startsElse(size_t i)
+    {
+        available(i + 5);
+        return buffer.compare(i, 4, "else") == 0 && (i + 4 >= buffer.size() || !isIdentChar(buffer[i + 4]));
+    }
+};
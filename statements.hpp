@@ -1,130 +1,96 @@
-#include <regex>
 #include <string>
 #include <vector>
-#include <unordered_map>
 #include <iostream>
+#include "ast.hpp"
+#include "function.hpp"
+#include "expressions.hpp"
+#include "output.hpp"
 using namespace std;
 
-// Forward declaration so linker knows about this
-void executeLine(const string& line,
-                 unordered_map<string, string>& strVars,
-                 unordered_map<string, double>& numVars,
-                 unordered_map<string, bool>& boolVars,
-                 unordered_map<string, CatFunction>& functions);
+bool executeStatement(const Stmt& stmt, Frame& frame, CatValue* returnValue);
 
-bool evaluateCondition(const string& expr,
-                       unordered_map<string, string>& strVars,
-                       unordered_map<string, double>& numVars,
-                       unordered_map<string, bool>& boolVars);
+bool evaluateCondition(const Expr& expr, Frame& frame) {
+    return evalBool(expr, frame);
+}
 
 // Executes if/else blocks
-void executeIfStatement(bool condition,
-                        const vector<string>& trueBlock,
-                        const vector<string>& falseBlock,
-                        unordered_map<string, string>& strVars,
-                        unordered_map<string, double>& numVars,
-                        unordered_map<string, bool>& boolVars,
-                        unordered_map<string, CatFunction>& functions) {
-    const vector<string>& block = condition ? trueBlock : falseBlock;
-    for (const auto& line : block) {
-        executeLine(line, strVars, numVars, boolVars, functions);
-    }
+// Returns true when a return statement inside the taken branch ran.
+bool executeIfStatement(bool condition,
+                        const Block& trueBlock,
+                        const Block& falseBlock,
+                        Frame& frame,
+                        CatValue* returnValue) {
+    const Block& block = condition ? trueBlock : falseBlock;
+    return executeBlock(block, frame, returnValue);
 }
 
-// Main if/else handling logic inside interpreter loop
-void handleIfElse(const vector<string>& programLines,
-                  unordered_map<string, string>& strVars,
-                  unordered_map<string, double>& numVars,
-                  unordered_map<string, bool>& boolVars,
-                  unordered_map<string, CatFunction>& functions) {
-
-    regex ifRegex(R"(^\s*if\s*\((.+)\)\s*\{\s*$)");
-    regex elseRegex(R"(^\s*(?:\}\s*)?else\s*\{\s*$)");
-    smatch match;
-
-    bool inIfBlock = false;
-    bool inElseBlock = false;
-    string currentCondition;
-    vector<string> trueBlock;
-    vector<string> falseBlock;
-
-    for (const auto& line : programLines) {
-        if (!inIfBlock && regex_match(line, match, ifRegex)) {
-            // Beginning of an if-statement
-            inIfBlock = true;
-            currentCondition = match[1];
-            trueBlock.clear();
-            falseBlock.clear();
-        }
-        else if (inIfBlock && !inElseBlock && regex_match(line, match, elseRegex)) {
-            // Start of else-block
-            inElseBlock = true;
-        }
-        else if (line.find("}") != string::npos && inIfBlock) {
-            // End of if/else block
-            bool conditionResult = evaluateCondition(currentCondition, strVars, numVars, boolVars);
-            executeIfStatement(conditionResult, trueBlock, falseBlock, strVars, numVars, boolVars, functions);
-
-            // Reset state
-            inIfBlock = false;
-            inElseBlock = false;
-            trueBlock.clear();
-            falseBlock.clear();
-        }
-        else if (inIfBlock) {
-            // Collect lines inside current block
-            if (inElseBlock)
-                falseBlock.push_back(line);
-            else
-                trueBlock.push_back(line);
-        }
-        else {
-            // Handle as a normal line outside of if/else
-            executeLine(line, strVars, numVars, boolVars, functions);
-        }
+// Runs statements in order until one of them returns
+bool executeBlock(const Block& block, Frame& frame, CatValue* returnValue) {
+    for (const auto& stmt : block) {
+        if (executeStatement(*stmt, frame, returnValue))
+            return true;
     }
+    return false;
 }
-bool evaluateCondition(const string& expr,
-                       unordered_map<string, string>& strVars,
-                       unordered_map<string, double>& numVars,
-                       unordered_map<string, bool>& boolVars) {
-    smatch match;
 
-    
-    // Example: if ("cat" == "cat") or if (str1 == str2)
-    regex strEq(R"delim(^\s*"([^"]+)"\s*==\s*"([^"]+)"\s*$)delim");
-    if (regex_match(expr, match, strEq)) {
-        return match[1].str() == match[2].str();
+// Executes one statement; returns true if it was a return
+bool executeStatement(const Stmt& stmt, Frame& frame, CatValue* returnValue) {
+    switch (stmt.kind) {
+    case StmtKind::Purr: {
+        if (stmt.printsDirect) {
+            size_t from = output.buffer.size();
+            renderPurr(*stmt.value, frame, output.buffer);
+            output.commit(from);
+            return false;
+        }
+        // built in full before printing, since a call inside may print too
+        string text;
+        renderPurr(*stmt.value, frame, text);
+        output.write(text);
+        return false;
     }
 
-    
-    // Handles: ==, !=, <, >, <=, >= between variables or literals
-    regex numComp(R"(^\s*([A-Za-z_]\w*|\d+(?:\.\d+)?)\s*(==|!=|<|>|<=|>=)\s*([A-Za-z_]\w*|\d+(?:\.\d+)?)\s*$)");
-    if (regex_match(expr, match, numComp)) {
-        string left = match[1];
-        string op = match[2];
-        string right = match[3];
-
-        auto getValue = [&](const string& token) -> double {
-            if (numVars.count(token)) return numVars[token];
-            try { return stod(token); } catch (...) { return 0.0; }
-        };
+    case StmtKind::Declare:
+        if (stmt.type == "num")
+            frameFor(stmt.scope, frame)[stmt.slot] = evalNumber(*stmt.value, frame);
+        else
+            frameFor(stmt.scope, frame)[stmt.slot] = coerceTo(stmt.type, evaluate(*stmt.value, frame));
+        return false;
 
-        double lhs = getValue(left);
-        double rhs = getValue(right);
+    case StmtKind::Call:
+        callFunction(*stmt.value, frame);
+        return false;
 
-        if (op == "==") return lhs == rhs;
-        if (op == "!=") return lhs != rhs;
-        if (op == "<")  return lhs < rhs;
-        if (op == ">")  return lhs > rhs;
-        if (op == "<=") return lhs <= rhs;
-        if (op == ">=") return lhs >= rhs;
+    case StmtKind::If: {
+        bool condResult = evaluateCondition(*stmt.value, frame);
+        return executeIfStatement(condResult, stmt.body, stmt.elseBody, frame, returnValue);
     }
 
-    
-    if (boolVars.count(expr)) return boolVars[expr];
+    case StmtKind::While:
+        // the condition and body are the resolved tree: nothing is re-parsed per pass
+        if (stmt.init)
+            executeStatement(*stmt.init, frame, returnValue);
+        while (evaluateCondition(*stmt.value, frame)) {
+            if (executeBlock(stmt.body, frame, returnValue))
+                return true;
+            if (stmt.step)
+                executeStatement(*stmt.step, frame, returnValue);
+        }
+        return false;
+
+    case StmtKind::Return:
+        if (returnValue && stmt.value) {
+            // a call in tail position is made by executeFunction, in this call's place
+            if (stmt.value->kind == ExprKind::Call && prepareTailCall(*stmt.value, frame))
+                return true;
+            *returnValue = evaluate(*stmt.value, frame);
+        }
+        return true;
 
-    
-    cerr << "Invalid condition: " << expr << endl;
+    case StmtKind::Function:
+        // (re)definition takes effect when execution reaches it
+        defineFunction(stmt.name, CatFunction{&stmt});
+        return false;
+    }
     return false;
 }
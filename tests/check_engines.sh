@@ -0,0 +1,26 @@
+#!/bin/sh
+# check_engines.sh
+# Runs every tests/*.cat on each engine and compares what it prints with
+# tests/<name>.out, so the engines cannot drift apart.
+# Run from the repository root after building the interpreter:
+#   g++ -std=c++17 -O2 -o catlang CatLang.cpp && tests/check_engines.sh [./catlang]
+catlang=${1:-./catlang}
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+status=0
+for script in tests/*.cat; do
+    expected=${script%.cat}.out
+    for engine in --engine=tree --engine=vm --jit=on --build; do
+        if [ "$engine" = --build ]; then
+            "$catlang" --emit-cpp="$work/script.cpp" --build "$script" >/dev/null 2>&1 && "$work/script" >"$work/out" 2>/dev/null
+        else
+            "$catlang" $engine "$script" >"$work/out" 2>/dev/null
+        fi
+        if ! cmp -s "$work/out" "$expected"; then
+            echo "FAIL $script ($engine)"
+            status=1
+        fi
+    done
+done
+[ $status = 0 ] && echo "all engines agree"
+exit $status
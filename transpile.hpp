@@ -0,0 +1,1184 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <spawn.h>
+#include <string>
+#include <string_view>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "ast.hpp"
+#include "function.hpp"
+#include "resolver.hpp"
+
+// --- Ahead-of-time translation to C++ (--emit-cpp) ---
+// A resolved (and folded) program becomes one standalone C++17 translation unit:
+//   - a global declared with one type is a typed static (Slot<double>,
+//     Slot<std::string>, Slot<bool>) that remembers whether it has been assigned;
+//     a global declared with several types is a dynamic CatValue. Function locals
+//     get the same treatment, as C++ locals;
+//   - every function definition is a native function taking its typed parameters
+//     and returning its declared type. A definition takes effect when main reaches
+//     it (def_<name> holds the one in force), so calls before it, and calls after
+//     a redefinition, behave as in the interpreter;
+//   - purr appends to a buffered output sink like output.hpp's, and numbers are
+//     formatted by the same to_chars call as formatNumber().
+// The runtime helpers below are small copies of the interpreter's conversions
+// (toNumber, toText, toBool, compareValues), so the program prints exactly what
+// the tree walker would. Operands are evaluated in source order. A `return` of a
+// call to the function itself jumps back to its start; other calls nest, up to
+// the --max-depth in force when the script was translated. A --flush policy given
+// at translation is built in; otherwise the program picks one as catlang does.
+
+// --- Runtime support copied into every generated program ---
+const char *cppPrelude = R"CPP(#include <charconv>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace
+{
+
+// --- Values ---
+// a variable declared with more than one type
+struct CatValue
+{
+    enum class Tag : unsigned char
+    {
+        Nil,
+        Str,
+        Num,
+        Bool
+    };
+
+    Tag tag = Tag::Nil;
+    double num = 0;
+    bool boolean = false;
+    std::string str;
+
+    CatValue() = default;
+    CatValue(double value) : tag(Tag::Num), num(value) {}
+    CatValue(bool value) : tag(Tag::Bool), boolean(value) {}
+    CatValue(std::string value) : tag(Tag::Str), str(std::move(value)) {}
+};
+
+// a variable of one declared type; unset until a declaration assigns it
+template <typename T>
+struct Slot
+{
+    T value{};
+    bool set = false;
+};
+
+template <typename T, typename U>
+inline void put(Slot<T> &slot, U &&value)
+{
+    slot.value = std::forward<U>(value);
+    slot.set = true;
+}
+
+// --- Conversions (as in the interpreter's function.hpp) ---
+// same format as formatNumber(): %g, 6 significant digits, no trailing zeros
+inline void appendNumber(std::string &out, double num)
+{
+    char buf[32];
+    auto result = std::to_chars(buf, buf + sizeof buf, num, std::chars_format::general, 6);
+    out.append(buf, result.ptr);
+}
+
+inline double toNumber(double value) { return value; }
+inline double toNumber(bool value) { return value ? 1.0 : 0.0; }
+inline double toNumber(const std::string &value)
+{
+    try
+    {
+        return std::stod(value);
+    }
+    catch (...)
+    {
+    }
+    return 0.0;
+}
+inline double toNumber(const CatValue &value)
+{
+    switch (value.tag)
+    {
+    case CatValue::Tag::Num:
+        return value.num;
+    case CatValue::Tag::Bool:
+        return value.boolean ? 1.0 : 0.0;
+    case CatValue::Tag::Str:
+        return toNumber(value.str);
+    default:
+        return 0.0;
+    }
+}
+template <typename T>
+inline double toNumber(const Slot<T> &slot) { return toNumber(slot.value); }
+
+inline bool toBool(double value) { return value != 0.0; }
+inline bool toBool(bool value) { return value; }
+inline bool toBool(const std::string &value) { return !value.empty(); }
+inline bool toBool(const CatValue &value)
+{
+    switch (value.tag)
+    {
+    case CatValue::Tag::Bool:
+        return value.boolean;
+    case CatValue::Tag::Num:
+        return value.num != 0.0;
+    case CatValue::Tag::Str:
+        return !value.str.empty();
+    default:
+        return false;
+    }
+}
+template <typename T>
+inline bool toBool(const Slot<T> &slot) { return toBool(slot.value); }
+
+inline void appendText(std::string &out, double value) { appendNumber(out, value); }
+inline void appendText(std::string &out, bool value) { out += value ? "true" : "false"; }
+inline void appendText(std::string &out, const std::string &value) { out += value; }
+inline void appendText(std::string &out, const CatValue &value)
+{
+    switch (value.tag)
+    {
+    case CatValue::Tag::Str:
+        out += value.str;
+        break;
+    case CatValue::Tag::Num:
+        appendNumber(out, value.num);
+        break;
+    case CatValue::Tag::Bool:
+        out += value.boolean ? "true" : "false";
+        break;
+    default:
+        break;
+    }
+}
+template <typename T>
+inline void appendText(std::string &out, const Slot<T> &slot)
+{
+    if (slot.set)
+        appendText(out, slot.value);
+}
+
+inline std::string toText(std::string value) { return value; }
+template <typename T>
+inline std::string toText(const T &value)
+{
+    std::string out;
+    appendText(out, value);
+    return out;
+}
+
+inline bool isSet(const CatValue &value) { return value.tag != CatValue::Tag::Nil; }
+template <typename T>
+inline bool isSet(const Slot<T> &slot) { return slot.set; }
+
+inline bool isText(double) { return false; }
+inline bool isText(bool) { return false; }
+inline bool isText(const std::string &) { return true; }
+inline bool isText(const CatValue &value) { return value.tag == CatValue::Tag::Str; }
+inline bool isText(const Slot<std::string> &slot) { return slot.set; }
+template <typename T>
+inline bool isText(const Slot<T> &) { return false; }
+
+template <typename T>
+inline const std::string &textOf(const T &)
+{
+    static const std::string none;
+    return none;
+}
+inline const std::string &textOf(const std::string &value) { return value; }
+inline const std::string &textOf(const CatValue &value) { return value.str; }
+inline const std::string &textOf(const Slot<std::string> &slot) { return slot.value; }
+
+// a purr'd variable that has not been assigned yet prints as its name
+template <typename T>
+inline void renderVariable(std::string &out, const T &variable, const char *name)
+{
+    if (isSet(variable))
+        appendText(out, variable);
+    else
+        out += name;
+}
+
+// '+' with a possible str operand joins text
+template <typename A, typename B>
+inline CatValue add(const A &lhs, const B &rhs)
+{
+    if (isText(lhs) || isText(rhs))
+    {
+        std::string text;
+        appendText(text, lhs);
+        appendText(text, rhs);
+        return text;
+    }
+    return toNumber(lhs) + toNumber(rhs);
+}
+
+enum class Op
+{
+    Equal,
+    NotEqual,
+    Less,
+    Greater,
+    LessEqual,
+    GreaterEqual
+};
+
+// two strs compare as text, anything else compares numerically
+template <typename A, typename B>
+inline bool compareValues(Op op, const A &lhs, const B &rhs)
+{
+    if (isText(lhs) && isText(rhs))
+    {
+        int c = textOf(lhs).compare(textOf(rhs));
+        switch (op)
+        {
+        case Op::Equal:
+            return c == 0;
+        case Op::NotEqual:
+            return c != 0;
+        case Op::Less:
+            return c < 0;
+        case Op::Greater:
+            return c > 0;
+        case Op::LessEqual:
+            return c <= 0;
+        default:
+            return c >= 0;
+        }
+    }
+    double l = toNumber(lhs), r = toNumber(rhs);
+    switch (op)
+    {
+    case Op::Equal:
+        return l == r;
+    case Op::NotEqual:
+        return l != r;
+    case Op::Less:
+        return l < r;
+    case Op::Greater:
+        return l > r;
+    case Op::LessEqual:
+        return l <= r;
+    default:
+        return l >= r;
+    }
+}
+
+// --- Buffered output (as in output.hpp) ---
+enum class FlushPolicy
+{
+    Line,
+    Full,
+    None
+};
+
+struct OutputSink
+{
+    static const size_t capacity = 64 * 1024;
+
+    std::string buffer;
+    FlushPolicy policy = isatty(STDOUT_FILENO) ? FlushPolicy::Line : FlushPolicy::Full;
+
+    OutputSink() { buffer.reserve(capacity); }
+    ~OutputSink() { flush(); }
+
+    void write(const std::string &text)
+    {
+        size_t from = buffer.size();
+        buffer += text;
+        commit(from);
+    }
+
+    void commit(size_t from)
+    {
+        if (policy == FlushPolicy::None)
+            return;
+        if (buffer.size() >= capacity ||
+            (policy == FlushPolicy::Line && std::memchr(buffer.data() + from, '\n', buffer.size() - from)))
+            flush();
+    }
+
+    void flush()
+    {
+        size_t done = 0;
+        while (done < buffer.size())
+        {
+            ssize_t n = ::write(STDOUT_FILENO, buffer.data() + done, buffer.size() - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            done += (size_t)n;
+        }
+        buffer.clear();
+    }
+};
+
+OutputSink output;
+
+inline std::ostream &errorStream()
+{
+    output.flush();
+    return std::cerr;
+}
+
+inline void undefinedFunction(const char *name)
+{
+    errorStream() << "Undefined function: " << name << std::endl;
+}
+
+template <typename T>
+inline T undefinedCall(const char *name, T nil)
+{
+    undefinedFunction(name);
+    return nil;
+}
+
+// --- Call depth (as in function.hpp) ---
+size_t maxCallDepth = 0;
+size_t callDepth = 0;
+const char *nativeStackTop = nullptr;
+size_t nativeStackBudget = 0;
+
+__attribute__((noinline)) void initNativeStack(size_t maxDepth)
+{
+    const size_t margin = 256 * 1024;
+    const size_t ceiling = (size_t)1 << 30;
+    struct rlimit limit;
+    size_t size = 8 * 1024 * 1024;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0)
+        size = limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > ceiling ? ceiling : (size_t)limit.rlim_cur;
+    nativeStackTop = (const char *)__builtin_frame_address(0);
+    nativeStackBudget = size > 2 * margin ? size - margin : size / 2;
+    maxCallDepth = maxDepth;
+}
+
+// a frame above the top (main's own locals) uses none of the stack
+size_t nativeStackUsed(const char *here)
+{
+    return (uintptr_t)here < (uintptr_t)nativeStackTop ? (size_t)(nativeStackTop - here) : 0;
+}
+
+inline std::string stackOverflowMessage(size_t depth)
+{
+    return "Stack overflow: more than " + std::to_string(depth) + " nested calls";
+}
+
+// one level of nesting for the lifetime of a native function's frame
+struct CallGuard
+{
+    CallGuard()
+    {
+        char here;
+        if (++callDepth > maxCallDepth)
+            throw std::runtime_error(stackOverflowMessage(maxCallDepth));
+        if (nativeStackUsed(&here) > nativeStackBudget)
+            throw std::runtime_error(stackOverflowMessage(callDepth - 1) + " (the native stack is full)");
+    }
+    ~CallGuard() { --callDepth; }
+};
+)CPP";
+
+// --- Translator ---
+struct CppEmitter
+{
+    // how a variable is stored in the generated code
+    enum class Storage
+    {
+        Num,  // Slot<double>
+        Str,  // Slot<std::string>
+        Bool, // Slot<bool>
+        Any   // CatValue
+    };
+
+    // what a generated expression has to produce
+    enum class Want
+    {
+        Num,  // double
+        Bool, // bool
+        Value // anything the runtime helpers accept
+    };
+
+    const Program &program;
+    const FrameLayout &globals;
+    std::string out;
+    int depth = 1;
+    std::unordered_map<Atom, std::vector<const Stmt *>> definitions; // per name, in source order
+    std::vector<Atom> definedNames;                                   // names in order of first definition
+    const Stmt *function = nullptr;                                   // function being translated
+    std::vector<Storage> localStorage;                                // its frame slots
+    bool tailJump = false;                                            // it returns a call to itself
+
+    CppEmitter(const Program &prog, const FrameLayout &layout) : program(prog), globals(layout) {}
+
+    static Storage storageFor(unsigned types)
+    {
+        switch (types)
+        {
+        case 1:
+            return Storage::Num;
+        case 2:
+            return Storage::Str;
+        case 4:
+            return Storage::Bool;
+        default:
+            return Storage::Any;
+        }
+    }
+
+    static const char *storageType(Storage storage)
+    {
+        switch (storage)
+        {
+        case Storage::Num:
+            return "Slot<double>";
+        case Storage::Str:
+            return "Slot<std::string>";
+        case Storage::Bool:
+            return "Slot<bool>";
+        default:
+            return "CatValue";
+        }
+    }
+
+    static const char *cppType(std::string_view type)
+    {
+        if (type == "num")
+            return "double";
+        if (type == "str")
+            return "std::string";
+        if (type == "bool")
+            return "bool";
+        return "void";
+    }
+
+    // what coerceTo(type, nil) gives: a missing argument or a return without a value
+    static const char *nilOf(std::string_view type)
+    {
+        if (type == "num")
+            return "0.0";
+        if (type == "str")
+            return "std::string()";
+        return "false";
+    }
+
+    // --- Literals ---
+    static std::string number(double value)
+    {
+        if (std::isnan(value))
+            return std::signbit(value) ? "-std::numeric_limits<double>::quiet_NaN()" : "std::numeric_limits<double>::quiet_NaN()";
+        if (std::isinf(value))
+            return value < 0 ? "-std::numeric_limits<double>::infinity()" : "std::numeric_limits<double>::infinity()";
+        char buf[64];
+        auto result = std::to_chars(buf, buf + sizeof buf, value); // shortest text that reads back exactly
+        std::string text(buf, result.ptr);
+        if (text.find_first_of(".e") == std::string::npos)
+            text += ".0";
+        return text;
+    }
+
+    static std::string quote(std::string_view text)
+    {
+        std::string quoted = "\"";
+        for (unsigned char c : text)
+        {
+            if (c == '"' || c == '\\')
+                (quoted += '\\') += (char)c;
+            else if (c == '\n')
+                quoted += "\\n";
+            else if (c == '\t')
+                quoted += "\\t";
+            else if (c >= 0x20 && c < 0x7f)
+                quoted += (char)c;
+            else
+            {
+                char octal[5] = {'\\', (char)('0' + (c >> 6)), (char)('0' + ((c >> 3) & 7)), (char)('0' + (c & 7)), 0};
+                quoted += octal;
+            }
+        }
+        return quoted + "\"";
+    }
+
+    // the literal and its length, for std::string(...) and append(...)
+    static std::string literal(std::string_view text)
+    {
+        return quote(text) + ", " + std::to_string(text.size());
+    }
+
+    static bool isLiteral(const Expr &expr)
+    {
+        return expr.kind == ExprKind::Number || expr.kind == ExprKind::String || expr.kind == ExprKind::Bool;
+    }
+
+    // --- Names ---
+    static std::string variableName(Atom name, SlotScope scope)
+    {
+        return (scope == SlotScope::Local ? "l_" : "g_") + atomName(name);
+    }
+
+    Storage storageOf(int slot, SlotScope scope) const
+    {
+        if (scope == SlotScope::Local)
+            return localStorage[slot];
+        return storageFor(slot < (int)globals.types.size() ? globals.types[slot] : 0);
+    }
+
+    std::string functionName(Atom name, size_t index) const
+    {
+        if (definitions.at(name).size() == 1)
+            return "f_" + atomName(name);
+        return "f" + std::to_string(index + 1) + "_" + atomName(name);
+    }
+
+    // --- Expressions ---
+    // num(), cond() and value() follow evalNumber(), evalBool() and evaluate().
+
+    // lhs before rhs, even when rhs calls a function that changes or prints something
+    template <typename Combine>
+    static std::string inOrder(const Expr &lhs, const std::string &l, const Expr &rhs, const std::string &r, Combine combine)
+    {
+        if (!containsCall(rhs) || isLiteral(lhs))
+            return combine(l, r);
+        return "[&] { auto lhs = " + l + "; return " + combine("lhs", r) + "; }()";
+    }
+
+    std::string arithmetic(const Expr &expr, const char *op)
+    {
+        const Expr &lhs = *expr.operands[0], &rhs = *expr.operands[1];
+        return inOrder(lhs, num(lhs), rhs, num(rhs),
+                       [&](const std::string &l, const std::string &r) { return "(" + l + " " + op + " " + r + ")"; });
+    }
+
+    std::string num(const Expr &expr)
+    {
+        switch (expr.kind)
+        {
+        case ExprKind::Number:
+            return number(expr.number);
+        case ExprKind::String:
+            return number(toNumber(CatValue(std::string(expr.text))));
+        case ExprKind::Bool:
+            return expr.boolean ? "1.0" : "0.0";
+        case ExprKind::Variable:
+            return expr.slot < 0 ? "0.0" : "toNumber(" + variableName(expr.name, expr.scope) + ")";
+        case ExprKind::Call:
+            return call(expr, Want::Num);
+        case ExprKind::Negate:
+            return "-(" + num(*expr.operands[0]) + ")";
+        case ExprKind::Binary:
+            switch (expr.op)
+            {
+            case BinaryOp::Add:
+                if (expr.numeric)
+                    return arithmetic(expr, "+");
+                break;
+            case BinaryOp::Sub:
+                return arithmetic(expr, "-");
+            case BinaryOp::Mul:
+                return arithmetic(expr, "*");
+            case BinaryOp::Div:
+                return arithmetic(expr, "/");
+            default:
+                return "(" + cond(expr) + " ? 1.0 : 0.0)";
+            }
+            break;
+        case ExprKind::Not:
+        case ExprKind::And:
+        case ExprKind::Or:
+            return "(" + cond(expr) + " ? 1.0 : 0.0)";
+        default:
+            break;
+        }
+        return "toNumber(" + value(expr) + ")";
+    }
+
+    std::string cond(const Expr &expr)
+    {
+        static const char *cppOps[] = {"==", "!=", "<", ">", "<=", ">="};
+        static const char *opNames[] = {"Op::Equal", "Op::NotEqual", "Op::Less", "Op::Greater", "Op::LessEqual", "Op::GreaterEqual"};
+        switch (expr.kind)
+        {
+        case ExprKind::Number:
+            return expr.number != 0.0 ? "true" : "false";
+        case ExprKind::String:
+            return expr.text.empty() ? "false" : "true";
+        case ExprKind::Bool:
+            return expr.boolean ? "true" : "false";
+        case ExprKind::Variable:
+            return expr.slot < 0 ? "false" : "toBool(" + variableName(expr.name, expr.scope) + ")";
+        case ExprKind::Call:
+            return call(expr, Want::Bool);
+        case ExprKind::Not:
+            return "!" + cond(*expr.operands[0]);
+        case ExprKind::And:
+            return "(" + cond(*expr.operands[0]) + " && " + cond(*expr.operands[1]) + ")";
+        case ExprKind::Or:
+            return "(" + cond(*expr.operands[0]) + " || " + cond(*expr.operands[1]) + ")";
+        case ExprKind::Binary:
+        {
+            if (expr.op < BinaryOp::Equal)
+                break;
+            const Expr &lhs = *expr.operands[0], &rhs = *expr.operands[1];
+            int op = (int)expr.op - (int)BinaryOp::Equal;
+            if (lhs.numeric || rhs.numeric)
+                return inOrder(lhs, num(lhs), rhs, num(rhs),
+                               [&](const std::string &l, const std::string &r) { return "(" + l + " " + cppOps[op] + " " + r + ")"; });
+            return inOrder(lhs, value(lhs), rhs, value(rhs), [&](const std::string &l, const std::string &r)
+                           { return std::string("compareValues(") + opNames[op] + ", " + l + ", " + r + ")"; });
+        }
+        default:
+            break;
+        }
+        return "toBool(" + value(expr) + ")";
+    }
+
+    std::string value(const Expr &expr)
+    {
+        switch (expr.kind)
+        {
+        case ExprKind::Number:
+            return number(expr.number);
+        case ExprKind::String:
+            return "std::string(" + literal(expr.text) + ")";
+        case ExprKind::Bool:
+            return expr.boolean ? "true" : "false";
+        case ExprKind::Variable:
+            return expr.slot < 0 ? "CatValue()" : variableName(expr.name, expr.scope);
+        case ExprKind::Call:
+            return call(expr, Want::Value);
+        case ExprKind::Concat:
+        {
+            std::string code = "[&] { std::string text; ";
+            for (const ExprPtr &part : expr.operands)
+            {
+                if (part->kind == ExprKind::String)
+                    code += "text.append(" + literal(part->text) + "); ";
+                else
+                    code += "appendText(text, " + value(*part) + "); ";
+            }
+            return code + "return text; }()";
+        }
+        case ExprKind::Binary:
+            if (expr.op == BinaryOp::Add && !expr.numeric)
+            {
+                const Expr &lhs = *expr.operands[0], &rhs = *expr.operands[1];
+                return inOrder(lhs, value(lhs), rhs, value(rhs),
+                               [](const std::string &l, const std::string &r) { return "add(" + l + ", " + r + ")"; });
+            }
+            if (expr.op >= BinaryOp::Equal)
+                return cond(expr);
+            return num(expr);
+        case ExprKind::Negate:
+            return num(expr);
+        default:
+            return cond(expr);
+        }
+    }
+
+    // the value a parameter of the given type receives (coerceTo)
+    std::string argument(std::string_view type, const Expr &arg)
+    {
+        if (type == "num")
+            return num(arg);
+        if (type == "bool")
+            return cond(arg);
+        return "toText(" + value(arg) + ")";
+    }
+
+    // a call of one definition; arguments are evaluated left to right, all of them,
+    // and converted to the parameter types (missing ones get the empty value)
+    std::string nativeCall(const Expr &expr, const Stmt &def, const std::string &name)
+    {
+        const auto &args = expr.operands;
+        bool ordered = false;
+        for (const ExprPtr &arg : args)
+            ordered = ordered || containsCall(*arg);
+        ordered = ordered && (args.size() >= 2 || args.size() > def.params.size());
+
+        std::string code = ordered ? "[&] { " : "";
+        std::string call = name + "(";
+        for (size_t i = 0; i < def.params.size(); ++i)
+        {
+            std::string_view type = def.params[i].type;
+            std::string arg = i < args.size() ? argument(type, *args[i]) : nilOf(type);
+            if (ordered && i < args.size())
+            {
+                code += std::string(cppType(type)) + " arg" + std::to_string(i) + " = " + arg + "; ";
+                arg = "std::move(arg" + std::to_string(i) + ")";
+            }
+            call += (i ? ", " : "") + arg;
+        }
+        call += ")";
+        if (!ordered)
+            return call;
+        // arguments past the parameters only matter for what their calls do
+        for (size_t i = def.params.size(); i < args.size(); ++i)
+        {
+            if (containsCall(*args[i]))
+                code += "(void)(" + value(*args[i]) + "); ";
+        }
+        return code + "return " + call + "; }()";
+    }
+
+    // the arguments of a call to an undefined function still run first, as in
+    // both engines; only the ones with calls inside can be told apart
+    std::string undefinedArguments(const Expr &expr)
+    {
+        std::string code;
+        for (const ExprPtr &arg : expr.operands)
+        {
+            if (containsCall(*arg))
+                code += "(void)(" + value(*arg) + "); ";
+        }
+        return code;
+    }
+
+    // a call expression: the definition in force when it runs, converted to what is wanted
+    std::string call(const Expr &expr, Want want)
+    {
+        std::string name = atomName(expr.name);
+        const char *nil = want == Want::Num ? "0.0" : want == Want::Bool ? "false" : "CatValue()";
+        std::string code = "undefinedCall(" + quote(name) + ", " + nil + ")";
+        std::string arguments = undefinedArguments(expr);
+        if (!arguments.empty())
+            code = "[&] { " + arguments + "return " + code + "; }()";
+        auto it = definitions.find(expr.name);
+        if (it == definitions.end())
+            return code;
+        const std::vector<const Stmt *> &defs = it->second;
+        for (size_t k = defs.size(); k-- > 0;)
+        {
+            std::string result = nativeCall(expr, *defs[k], functionName(expr.name, k));
+            std::string_view type = defs[k]->type;
+            if (type == "void")
+                result = "(" + result + ", " + nil + ")";
+            else if (want == Want::Num)
+                result = type == "num" ? result : "toNumber(" + result + ")";
+            else if (want == Want::Bool)
+                result = type == "bool" ? result : "toBool(" + result + ")";
+            else
+                result = "CatValue(" + result + ")";
+            code = "def_" + name + " == " + std::to_string(k + 1) + " ? " + result + " : " + code;
+        }
+        return "(" + code + ")";
+    }
+
+    // --- Statements ---
+    void line(const std::string &text)
+    {
+        out.append(4 * depth, ' ');
+        out += text;
+        out += '\n';
+    }
+
+    void open()
+    {
+        line("{");
+        ++depth;
+    }
+
+    void close()
+    {
+        --depth;
+        line("}");
+    }
+
+    void block(const Block &stmts)
+    {
+        open();
+        for (const StmtPtr &stmt : stmts)
+            statement(*stmt);
+        close();
+    }
+
+    void purr(const Expr &expr)
+    {
+        // built in full first when a call inside may print too, like the tree walker
+        bool direct = !containsCall(expr);
+        open();
+        if (direct)
+        {
+            line("size_t from = output.buffer.size();");
+            line("std::string &text = output.buffer;");
+        }
+        else
+            line("std::string text;");
+        auto part = [&](const Expr &piece)
+        {
+            if (piece.kind == ExprKind::String)
+                line("text.append(" + literal(piece.text) + ");");
+            else if (piece.kind == ExprKind::Variable)
+            {
+                if (piece.slot >= 0)
+                    line("renderVariable(text, " + variableName(piece.name, piece.scope) + ", " + quote(atomName(piece.name)) + ");");
+            }
+            else
+                line("appendText(text, " + value(piece) + ");");
+        };
+        if (expr.kind == ExprKind::Concat)
+        {
+            for (const ExprPtr &piece : expr.operands)
+                part(*piece);
+        }
+        else
+            part(expr);
+        line(direct ? "output.commit(from);" : "output.write(text);");
+        close();
+    }
+
+    void declare(const Stmt &stmt)
+    {
+        std::string target = variableName(stmt.name, stmt.scope);
+        std::string assigned = stmt.type == "num" ? num(*stmt.value) : stmt.type == "bool" ? cond(*stmt.value) : "toText(" + value(*stmt.value) + ")";
+        if (storageOf(stmt.slot, stmt.scope) == Storage::Any)
+            line(target + " = CatValue(" + assigned + ");");
+        else
+            line("put(" + target + ", " + assigned + ");");
+    }
+
+    void callStatement(const Expr &expr)
+    {
+        std::string name = atomName(expr.name);
+        std::string undefined = "undefinedFunction(" + quote(name) + ");";
+        std::string arguments = undefinedArguments(expr);
+        if (!arguments.empty())
+            undefined = "{ " + arguments + undefined + " }";
+        auto it = definitions.find(expr.name);
+        if (it == definitions.end())
+        {
+            line(undefined);
+            return;
+        }
+        for (size_t k = 0; k < it->second.size(); ++k)
+        {
+            line(std::string(k ? "else if" : "if") + " (def_" + name + " == " + std::to_string(k + 1) + ")");
+            ++depth;
+            line(nativeCall(expr, *it->second[k], functionName(expr.name, k)) + ";");
+            --depth;
+        }
+        line("else");
+        ++depth;
+        line(undefined);
+        --depth;
+    }
+
+    bool isSelfCall(const Expr &expr) const
+    {
+        return expr.kind == ExprKind::Call && expr.name == function->name && definitions.at(function->name).size() == 1;
+    }
+
+    void returnStatement(const Stmt &stmt)
+    {
+        std::string_view type = function->type;
+        if (stmt.value && isSelfCall(*stmt.value))
+        {
+            // the call takes this call's place: new arguments, a fresh frame
+            open();
+            const auto &args = stmt.value->operands;
+            for (size_t i = 0; i < function->params.size(); ++i)
+            {
+                std::string_view paramType = function->params[i].type;
+                line(std::string(cppType(paramType)) + " next" + std::to_string(i) + " = " +
+                     (i < args.size() ? argument(paramType, *args[i]) : nilOf(paramType)) + ";");
+            }
+            for (size_t i = function->params.size(); i < args.size(); ++i)
+            {
+                if (containsCall(*args[i]))
+                    line("(void)(" + value(*args[i]) + ");");
+            }
+            for (size_t i = 0; i < function->params.size(); ++i)
+                line("a" + std::to_string(i) + " = std::move(next" + std::to_string(i) + ");");
+            line("goto tail;");
+            close();
+            return;
+        }
+        if (type == "void")
+        {
+            if (stmt.value && containsCall(*stmt.value))
+                line("(void)(" + value(*stmt.value) + ");");
+            line("return;");
+        }
+        else if (!stmt.value)
+            line(std::string("return ") + nilOf(type) + ";");
+        else
+            line("return " + (type == "num" ? num(*stmt.value) : type == "bool" ? cond(*stmt.value) : "toText(" + value(*stmt.value) + ")") + ";");
+    }
+
+    void statement(const Stmt &stmt)
+    {
+        switch (stmt.kind)
+        {
+        case StmtKind::Purr:
+            purr(*stmt.value);
+            return;
+        case StmtKind::Declare:
+            declare(stmt);
+            return;
+        case StmtKind::Call:
+            callStatement(*stmt.value);
+            return;
+        case StmtKind::If:
+            line("if (" + cond(*stmt.value) + ")");
+            block(stmt.body);
+            if (!stmt.elseBody.empty())
+            {
+                line("else");
+                block(stmt.elseBody);
+            }
+            return;
+        case StmtKind::While:
+            open();
+            if (stmt.init)
+                statement(*stmt.init);
+            line("while (" + cond(*stmt.value) + ")");
+            open();
+            for (const StmtPtr &inner : stmt.body)
+                statement(*inner);
+            if (stmt.step)
+                statement(*stmt.step);
+            close();
+            close();
+            return;
+        case StmtKind::Return:
+            returnStatement(stmt);
+            return;
+        case StmtKind::Function:
+        {
+            // (re)definition takes effect when execution reaches it
+            const std::vector<const Stmt *> &defs = definitions.at(stmt.name);
+            size_t index = std::find(defs.begin(), defs.end(), &stmt) - defs.begin();
+            line("def_" + atomName(stmt.name) + " = " + std::to_string(index + 1) + ";");
+            return;
+        }
+        }
+    }
+
+    // --- Functions ---
+    std::string signature(const Stmt &def, size_t index) const
+    {
+        std::string text = std::string(cppType(def.type)) + " " + functionName(def.name, index) + "(";
+        for (size_t i = 0; i < def.params.size(); ++i)
+            text += (i ? ", " : "") + std::string(cppType(def.params[i].type)) + " a" + std::to_string(i);
+        return text + ")";
+    }
+
+    static bool hasSelfTailCall(const Block &stmts, const Stmt &def)
+    {
+        for (const StmtPtr &stmt : stmts)
+        {
+            if (stmt->kind == StmtKind::Return && stmt->value && stmt->value->kind == ExprKind::Call && stmt->value->name == def.name)
+                return true;
+            if (hasSelfTailCall(stmt->body, def) || hasSelfTailCall(stmt->elseBody, def))
+                return true;
+        }
+        return false;
+    }
+
+    void functionBody(const Stmt &def, size_t index)
+    {
+        function = &def;
+
+        // slot types as the resolver saw them: parameters, declarations, seeded globals
+        std::vector<unsigned> types(def.frameSize, 0);
+        std::vector<Atom> names(def.frameSize, NoAtom);
+        for (const FuncArg &param : def.params)
+        {
+            types[param.slot] |= Resolver::typeBit(param.type);
+            names[param.slot] = param.name;
+        }
+        std::vector<const Stmt *> declared;
+        Resolver::collectDeclarationStmts(def.body, declared);
+        for (const Stmt *decl : declared)
+        {
+            types[decl->slot] |= Resolver::typeBit(decl->type);
+            names[decl->slot] = decl->name;
+        }
+        for (const auto &seed : def.globalSeeds)
+            types[seed.first] |= globals.types[seed.second];
+        localStorage.clear();
+        for (unsigned mask : types)
+            localStorage.push_back(storageFor(mask));
+
+        depth = 0;
+        line(signature(def, index));
+        open();
+        line("CallGuard guard;");
+        tailJump = definitions.at(def.name).size() == 1 && hasSelfTailCall(def.body, def);
+        if (tailJump)
+        {
+            --depth;
+            line("tail:");
+            ++depth;
+        }
+        open();
+        for (int slot = 0; slot < def.frameSize; ++slot)
+            line(std::string(storageType(localStorage[slot])) + " " + variableName(names[slot], SlotScope::Local) + ";");
+        for (const auto &seed : def.globalSeeds)
+        {
+            std::string local = variableName(names[seed.first], SlotScope::Local);
+            std::string global = variableName(globals.slots[seed.second].name, SlotScope::Global);
+            bool same = localStorage[seed.first] == storageOf(seed.second, SlotScope::Global);
+            if (same)
+                line(local + " = " + global + ";");
+            else
+                line("if (isSet(" + global + ")) " + local + " = CatValue(" + global + ".value);");
+        }
+        for (size_t i = 0; i < def.params.size(); ++i)
+        {
+            const FuncArg &param = def.params[i];
+            std::string local = variableName(param.name, SlotScope::Local);
+            std::string arg = "std::move(a" + std::to_string(i) + ")";
+            if (localStorage[param.slot] == Storage::Any)
+                line(local + " = CatValue(" + arg + ");");
+            else
+                line("put(" + local + ", " + arg + ");");
+        }
+        for (const StmtPtr &stmt : def.body)
+            statement(*stmt);
+        close();
+        if (def.type != "void")
+            line(std::string("return ") + nilOf(def.type) + ";");
+        close();
+        line("");
+        function = nullptr;
+    }
+
+    // --- Whole program ---
+    // flush: the output policy to build in, or null to choose it at run time
+    std::string emit(const std::string &scriptName, size_t maxDepth, const FlushPolicy *flush)
+    {
+        for (const StmtPtr &stmt : program)
+        {
+            if (stmt->kind != StmtKind::Function)
+                continue;
+            std::vector<const Stmt *> &defs = definitions[stmt->name];
+            if (defs.empty())
+                definedNames.push_back(stmt->name);
+            defs.push_back(stmt);
+        }
+
+        out = "// Generated by catlang --emit-cpp from " + scriptName + "; do not edit.\n";
+        out += cppPrelude;
+        out += "\n// --- Globals ---\n";
+        for (size_t i = 0; i < globals.slots.size(); ++i)
+            out += std::string(storageType(storageOf((int)i, SlotScope::Global))) + " " +
+                   variableName(globals.slots[i].name, SlotScope::Global) + ";\n";
+
+        out += "\n// --- Functions (def_<name>: the definition in force, 0 = not defined yet) ---\n";
+        for (Atom name : definedNames)
+            out += "int def_" + atomName(name) + " = 0;\n";
+        for (Atom name : definedNames)
+        {
+            for (size_t k = 0; k < definitions[name].size(); ++k)
+                out += signature(*definitions[name][k], k) + ";\n";
+        }
+        out += "\n";
+        for (Atom name : definedNames)
+        {
+            for (size_t k = 0; k < definitions[name].size(); ++k)
+                functionBody(*definitions[name][k], k);
+        }
+        out += "} // namespace\n\n";
+
+        depth = 0;
+        line("int main()");
+        open();
+        line("initNativeStack(" + std::to_string(maxDepth) + ");");
+        if (flush)
+        {
+            static const char *policies[] = {"Line", "Full", "None"};
+            line(std::string("output.policy = FlushPolicy::") + policies[(int)*flush] + ";");
+        }
+        line("try");
+        open();
+        for (const StmtPtr &stmt : program)
+            statement(*stmt);
+        close();
+        line("catch (const std::runtime_error &e)");
+        open();
+        line("errorStream() << e.what() << std::endl;");
+        line("return 1;");
+        close();
+        line("output.flush();");
+        line("return 0;");
+        close();
+        return out;
+    }
+};
+
+// --- Where the translation of a script goes: hello.cat -> hello.cpp ---
+inline std::string cppPathFor(const std::string &script)
+{
+    std::string base = script;
+    for (std::string_view ext : {".catlang", ".cat"})
+    {
+        if (base.size() >= ext.size() && base.compare(base.size() - ext.size(), ext.size(), ext) == 0)
+        {
+            base.erase(base.size() - ext.size());
+            break;
+        }
+    }
+    return base + ".cpp";
+}
+
+// --- Translate a resolved program and write it to path ("-" = stdout) ---
+// keepFlush: --flush was given, so the program uses output.policy instead of choosing its own
+inline bool emitCpp(const Program &program, const FrameLayout &globals, const std::string &scriptName,
+                    const std::string &path, bool keepFlush)
+{
+    std::string code = CppEmitter(program, globals).emit(scriptName, maxCallDepth, keepFlush ? &output.policy : nullptr);
+    if (path == "-")
+    {
+        std::cout << code;
+        return (bool)std::cout.flush();
+    }
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << code;
+    return (bool)file.flush();
+}
+
+// --- --build: compile the translation with the system C++ compiler ($CXX, else c++) ---
+// hello.cpp becomes the executable hello. Returns false if the compiler did not succeed.
+inline bool buildCpp(const std::string &cppPath, std::string &exePath)
+{
+    const std::string suffix = ".cpp";
+    bool hasSuffix = cppPath.size() > suffix.size() && cppPath.compare(cppPath.size() - suffix.size(), suffix.size(), suffix) == 0;
+    exePath = hasSuffix ? cppPath.substr(0, cppPath.size() - suffix.size()) : cppPath + ".out";
+
+    const char *cxx = std::getenv("CXX");
+    std::string compiler = cxx && *cxx ? cxx : "c++";
+    std::vector<std::string> args = {compiler, "-std=c++17", "-O2", "-o", exePath, cppPath};
+    std::vector<char *> argv;
+    for (std::string &arg : args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    pid_t pid;
+    if (posix_spawnp(&pid, compiler.c_str(), nullptr, nullptr, argv.data(), environ) != 0)
+        return false;
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+            return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
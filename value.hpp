@@ -0,0 +1,136 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// --- Number formatting ---
+// append a number as ostream prints it (%g: 6 significant digits, no trailing zeros)
+inline void appendNumber(std::string &out, double num)
+{
+    char buf[32];
+    auto result = std::to_chars(buf, buf + sizeof buf, num, std::chars_format::general, 6);
+    out.append(buf, result.ptr);
+}
+
+inline std::string formatNumber(double num)
+{
+    std::string s;
+    appendNumber(s, num);
+    return s;
+}
+
+// --- Runtime value ---
+// 16 bytes: a tag plus one 8-byte payload. Numbers and bools live inline;
+// strings live in a reference-counted heap body, so copying a value (into an
+// argument list, a frame slot or a register) never copies the characters.
+class CatValue
+{
+public:
+    enum class Tag : uint8_t
+    {
+        Nil, // no value yet (unassigned variable, void result)
+        Str,
+        Num,
+        Bool
+    };
+
+    CatValue() : tag(Tag::Nil), bits(0) {}
+    CatValue(double value) : tag(Tag::Num), num(value) {}
+    // only a real bool, so pointers do not silently turn into bool values
+    template <typename T, typename = std::enable_if_t<std::is_same_v<T, bool>>>
+    CatValue(T value) : tag(Tag::Bool), bits(0) { boolean = value; }
+    CatValue(std::string value) : tag(Tag::Str), str(new StringBody{1, std::move(value)}) {}
+    CatValue(const char *value) : CatValue(std::string(value)) {}
+
+    CatValue(const CatValue &other) : tag(other.tag), bits(other.bits)
+    {
+        if (tag == Tag::Str)
+            ++str->refs;
+    }
+
+    CatValue(CatValue &&other) noexcept : tag(other.tag), bits(other.bits)
+    {
+        other.tag = Tag::Nil;
+    }
+
+    CatValue &operator=(const CatValue &other)
+    {
+        if (other.tag == Tag::Str)
+            ++other.str->refs;
+        release();
+        tag = other.tag;
+        bits = other.bits;
+        return *this;
+    }
+
+    CatValue &operator=(CatValue &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            tag = other.tag;
+            bits = other.bits;
+            other.tag = Tag::Nil;
+        }
+        return *this;
+    }
+
+    ~CatValue()
+    {
+        release();
+    }
+
+    Tag type() const { return tag; }
+    bool isNil() const { return tag == Tag::Nil; }
+    bool isString() const { return tag == Tag::Str; }
+    bool isNumber() const { return tag == Tag::Num; }
+    bool isBool() const { return tag == Tag::Bool; }
+
+    double asNumber() const { return num; }
+    bool asBool() const { return boolean; }
+    const std::string &asString() const { return str->text; }
+
+    // same type and same payload (numbers bit for bit, so 0 and -0 differ)
+    bool sameAs(const CatValue &other) const
+    {
+        if (tag != other.tag)
+            return false;
+        switch (tag)
+        {
+        case Tag::Str:
+            return str == other.str || str->text == other.str->text;
+        case Tag::Num:
+            return bits == other.bits;
+        case Tag::Bool:
+            return boolean == other.boolean;
+        default:
+            return true;
+        }
+    }
+
+private:
+    struct StringBody
+    {
+        size_t refs;
+        std::string text;
+    };
+
+    void release()
+    {
+        if (tag == Tag::Str && --str->refs == 0)
+            delete str;
+    }
+
+    Tag tag;
+    union
+    {
+        uint64_t bits; // whole payload, for copies
+        double num;
+        bool boolean;
+        StringBody *str;
+    };
+};
+
+static_assert(sizeof(CatValue) == 16, "CatValue should stay a 16-byte tagged value");
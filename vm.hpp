@@ -0,0 +1,317 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <iostream>
+#include "bytecode.hpp"
+#include "function.hpp"
+#include "expressions.hpp"
+#include "memo.hpp"
+#include "output.hpp"
+
+// --- Register VM ---
+// Calls do not recurse on the C++ stack: each call pushes a CallFrame whose
+// registers are a window of one shared register stack, and the dispatch loop
+// simply continues in the callee. Recursion depth is bounded only by
+// maxCallDepth and memory, and tail calls push no frame at all.
+struct CallFrame
+{
+    const Proto *proto;
+    size_t pc;
+    size_t base;      // first register of this frame in the register stack
+    size_t resultAt;  // caller register receiving the return value
+    bool memoized;    // the result goes into memoCache under memoKeys.back()
+};
+
+struct VM
+{
+    const BytecodeProgram &program;
+    std::vector<CatValue> globals;
+    std::vector<bool> globalSet;
+    std::vector<int> functionSlots; // call slot -> proto index, -1 while undefined
+    std::vector<const Proto *> callTargets; // call slot -> proto, null while undefined
+    std::vector<CatValue> registers;
+    std::vector<CallFrame> frames;
+    std::vector<std::string> memoKeys; // one per memoized frame, innermost last
+
+    explicit VM(const BytecodeProgram &prog)
+        : program(prog),
+          globals(prog.globalNames.size()),
+          globalSet(prog.globalNames.size(), false),
+          functionSlots(prog.functionNames.size(), -1),
+          callTargets(prog.functionNames.size(), nullptr)
+    {
+    }
+
+    // (re)defines the function behind a call slot; calls read the proto straight from callTargets
+    void define(size_t slot, int proto)
+    {
+        functionSlots[slot] = proto;
+        callTargets[slot] = proto < 0 ? nullptr : &program.protos[proto];
+    }
+
+    // make sure registers [base, base + count) exist
+    void reserve(size_t base, size_t count)
+    {
+        if (registers.size() < base + count)
+            registers.resize(base + count);
+    }
+
+    static double number(const CatValue &value)
+    {
+        return value.isNumber() ? value.asNumber() : toNumber(value);
+    }
+
+    static bool compare(OpCode op, const CatValue &lhs, const CatValue &rhs)
+    {
+        static const BinaryOp ops[] = {BinaryOp::Equal, BinaryOp::NotEqual, BinaryOp::Less,
+                                       BinaryOp::Greater, BinaryOp::LessEqual, BinaryOp::GreaterEqual};
+        int index = op >= OpCode::BranchEq ? (int)op - (int)OpCode::BranchEq : (int)op - (int)OpCode::Eq;
+        if (lhs.isNumber() && rhs.isNumber())
+            return compareNumbers(ops[index], lhs.asNumber(), rhs.asNumber());
+        return compareValues(ops[index], lhs, rhs);
+    }
+
+    void run()
+    {
+        const Proto *main = &program.protos[0];
+        reserve(0, main->numRegs);
+        frames.push_back({main, 0, 0, 0, false});
+
+        CallFrame *frame = &frames.back();
+        const Instr *code = frame->proto->code.data();
+        const std::vector<CatValue> *K = &frame->proto->constants;
+        CatValue *R = registers.data() + frame->base;
+
+        for (;;)
+        {
+            const Instr &ins = code[frame->pc++];
+            switch (ins.op)
+            {
+            case OpCode::LoadK:
+                R[ins.a] = (*K)[ins.b];
+                break;
+            case OpCode::LoadNil:
+                R[ins.a] = CatValue();
+                break;
+            case OpCode::Move:
+                R[ins.a] = R[ins.b];
+                break;
+            case OpCode::LoadLocal:
+                if (R[ins.b].isNil())
+                    R[ins.a] = (*K)[ins.c];
+                else
+                    R[ins.a] = R[ins.b];
+                break;
+
+            case OpCode::GetGlobal:
+                if (globalSet[ins.b])
+                    R[ins.a] = globals[ins.b];
+                else if (ins.c == 1)
+                    R[ins.a] = program.globalNames[ins.b];
+                else
+                    R[ins.a] = CatValue();
+                break;
+            case OpCode::SetGlobal:
+                globals[ins.b] = R[ins.a];
+                globalSet[ins.b] = true;
+                break;
+
+            case OpCode::ToNum:
+                R[ins.a] = toNumber(R[ins.b]);
+                break;
+            case OpCode::ToStr:
+                R[ins.a] = toText(R[ins.b]);
+                break;
+            case OpCode::ToBool:
+                R[ins.a] = toBool(R[ins.b]);
+                break;
+
+            // arithmetic on two nums (the common case, e.g. loop counters) skips the conversions
+            case OpCode::Add:
+                if (R[ins.b].isNumber() && R[ins.c].isNumber())
+                    R[ins.a] = R[ins.b].asNumber() + R[ins.c].asNumber();
+                else if (R[ins.b].isString() || R[ins.c].isString())
+                    R[ins.a] = toText(R[ins.b]) + toText(R[ins.c]);
+                else
+                    R[ins.a] = toNumber(R[ins.b]) + toNumber(R[ins.c]);
+                break;
+            case OpCode::Sub:
+                R[ins.a] = number(R[ins.b]) - number(R[ins.c]);
+                break;
+            case OpCode::Mul:
+                R[ins.a] = number(R[ins.b]) * number(R[ins.c]);
+                break;
+            case OpCode::Div:
+                R[ins.a] = number(R[ins.b]) / number(R[ins.c]);
+                break;
+            case OpCode::Neg:
+                R[ins.a] = -toNumber(R[ins.b]);
+                break;
+            case OpCode::Not:
+                R[ins.a] = !toBool(R[ins.b]);
+                break;
+            case OpCode::Concat:
+                R[ins.a] = toText(R[ins.b]) + toText(R[ins.c]);
+                break;
+
+            case OpCode::Eq:
+            case OpCode::Ne:
+            case OpCode::Lt:
+            case OpCode::Gt:
+            case OpCode::Le:
+            case OpCode::Ge:
+                R[ins.a] = compare(ins.op, R[ins.b], R[ins.c]);
+                break;
+
+            case OpCode::BranchEq:
+            case OpCode::BranchNe:
+            case OpCode::BranchLt:
+            case OpCode::BranchGt:
+            case OpCode::BranchLe:
+            case OpCode::BranchGe:
+                if (!compare(ins.op, R[ins.a], R[ins.b]))
+                    frame->pc = ins.c;
+                break;
+            case OpCode::JumpIfFalse:
+                if (!toBool(R[ins.a]))
+                    frame->pc = ins.b;
+                break;
+            case OpCode::JumpIfTrue:
+                if (toBool(R[ins.a]))
+                    frame->pc = ins.b;
+                break;
+            case OpCode::Jump:
+                frame->pc = ins.a;
+                break;
+
+            case OpCode::Purr:
+            {
+                size_t from = output.buffer.size();
+                appendText(output.buffer, R[ins.a]);
+                output.commit(from);
+                break;
+            }
+            case OpCode::PurrK:
+                output.write((*K)[ins.a].asString());
+                break;
+
+            case OpCode::Define:
+                define(ins.a, ins.b);
+                break;
+
+            case OpCode::Call:
+            case OpCode::TailCall:
+            {
+                const Proto *callee = callTargets[ins.b];
+                if (!callee)
+                {
+                    errorStream() << "Undefined function: " << program.functionNames[ins.b] << std::endl;
+                    R[ins.a] = CatValue();
+                    break;
+                }
+                size_t argsAt = frame->base + ins.a;
+                size_t nparams = callee->params.size();
+
+                // a tail call whose result needs no conversion replaces the caller's
+                // frame, so tail recursion runs in constant space
+                const std::string &returnType = frame->proto->returnType;
+                if (ins.op == OpCode::TailCall && (callee->returnType == returnType || returnType == "void"))
+                {
+                    size_t base = frame->base;
+                    reserve(base, callee->numRegs);
+                    // argsAt + i >= base + i, so moving upwards never overwrites a pending argument
+                    for (size_t i = 0; i < (size_t)callee->numRegs; ++i)
+                    {
+                        if (i < nparams && i < (size_t)ins.c)
+                            registers[base + i] = std::move(registers[argsAt + i]);
+                        else
+                            registers[base + i] = CatValue();
+                    }
+                    frame->proto = callee;
+                    frame->pc = 0;
+                    code = callee->code.data();
+                    K = &callee->constants;
+                    R = registers.data() + base;
+                    break;
+                }
+
+                // a memoized function that has seen these arguments is not called at all
+                bool memo = memoizes(callee->pure, callee->declaredPure);
+                if (memo)
+                {
+                    std::string key;
+                    MemoCache::makeKey(key, (uint64_t)(callee - program.protos.data()), registers.data() + argsAt, (size_t)ins.c);
+                    if (const CatValue *cached = memoCache.find(key))
+                    {
+                        R[ins.a] = *cached;
+                        break;
+                    }
+                    memoKeys.push_back(std::move(key));
+                }
+
+                if (frames.size() > maxCallDepth)
+                {
+                    errorStream() << stackOverflowMessage(maxCallDepth) << std::endl;
+                    runAborted = true;
+                    frames.clear();
+                    memoKeys.clear();
+                    return;
+                }
+                size_t base = frame->base + frame->proto->numRegs;
+                reserve(base, callee->numRegs);
+
+                // arguments move into the callee's parameter registers; the rest start empty
+                for (size_t i = 0; i < (size_t)callee->numRegs; ++i)
+                {
+                    if (i < nparams && i < (size_t)ins.c)
+                        registers[base + i] = std::move(registers[argsAt + i]);
+                    else
+                        registers[base + i] = CatValue();
+                }
+
+                frames.push_back({callee, 0, base, argsAt, memo});
+                frame = &frames.back();
+                code = callee->code.data();
+                K = &callee->constants;
+                R = registers.data() + base;
+                break;
+            }
+
+            case OpCode::Return:
+            {
+                CatValue result = std::move(R[ins.a]);
+                size_t resultAt = frame->resultAt;
+                if (frame->memoized)
+                {
+                    memoCache.insert(std::move(memoKeys.back()), result);
+                    memoKeys.pop_back();
+                }
+                frames.pop_back();
+                frame = &frames.back();
+                code = frame->proto->code.data();
+                K = &frame->proto->constants;
+                R = registers.data() + frame->base;
+                registers[resultAt] = std::move(result);
+                break;
+            }
+
+            case OpCode::Halt:
+                frames.pop_back();
+                return;
+            }
+        }
+    }
+};
+
+// --- Run compiled bytecode ---
+inline void runOnVM(const BytecodeProgram &program)
+{
+    VM vm(program);
+    vm.run();
+}
+
+// --- Compile and run a parsed program on the VM ---
+inline void runOnVM(const Program &ast, const FrameLayout &globals)
+{
+    runOnVM(compileToBytecode(ast, globals));
+}